@@ -5,6 +5,7 @@
 #include "stm32f4xx_hal.h"
 #include "cyclesleep.h"
 #include "led.h"
+#include "led_anim.h"
 #include "usart.h"
 #include "printf.h"
 #include "shared_i2c.h"
@@ -12,11 +13,42 @@
 #include "tftwing.h"
 #include "st7735.h"
 #include "adc.h"
+#include "adc_cal.h"
+#include "adc_event.h"
+#include "goertzel.h"
+#include "scope.h"
+#include "spectrum.h"
+#include "rfft.h"
+#include "shell.h"
+#include "blog.h"
+#include "usb_cdc.h"
+#include "prof.h"
+#include "pcsamp.h"
+#include "irqstat.h"
+#include "idle.h"
+#include "sched.h"
+#include "bootseq.h"
 #include "arm_math.h"
 
 /* uncomment this to enable the OLED */
 //#define OLED
 
+/* uncomment this to run the scope view on A2 */
+//#define SCOPE
+
+/* uncomment this to run the spectrum analyzer on A2 instead */
+//#define SPECTRUM
+
+/* uncomment this to send ADC events as binary records for tools/blogdec */
+//#define BINLOG
+
+/* uncomment this to move the console & shell to the USB port */
+//#define USB_CONSOLE
+
+/* task state */
+uint32_t main_buttons;
+uint8_t main_cnt, main_hum = GOERTZEL_NONE, main_rows;
+
 /**
   * @brief  This function is executed in case of error occurrence.
   * @retval None
@@ -25,6 +57,129 @@ void Error_Handler(void)
 {
 }
 
+/*
+ * shell command - TFTWing button state
+ */
+static void main_btn(int argc, char **argv)
+{
+	printf("tftwing buttons = 0x%02X\n\r", tftwing_readButtons());
+}
+
+/*
+ * LED animation & red blink
+ */
+static void task_led(void)
+{
+	LEDAnimUpdate();
+	LEDToggle();
+}
+
+/*
+ * typed commands - woken by input, polled in case an idle is missed
+ */
+static void task_shell(void)
+{
+	shell_poll();
+}
+
+/*
+ * report TFTWing button changes - they read low when pressed
+ */
+static void task_btn(void)
+{
+	uint32_t btn = tftwing_readButtons() & TFTWING_BUTTON_ALL;
+
+	if(btn != main_buttons)
+		printf("\nbuttons 0x%04X @ %llu us\n\r", btn, cyc_to_us(cyccnt64()));
+	main_buttons = btn;
+}
+
+#ifdef OLED
+/*
+ * sweep radar
+ */
+static void task_radar(void)
+{
+	float32_t phs = 6.2832F*(float32_t)main_cnt/256.0F;
+
+	oled_line(0, 64, 16, 64+floorf(13.0F*cosf(phs)),
+		16-floorf(13.0F*sinf(phs)), 0);
+	main_cnt++;
+	phs = 6.2832F*(float32_t)main_cnt/256.0F;
+	oled_line(0, 64, 16, 64+floorf(13.0F*cosf(phs)),
+		16-floorf(13.0F*sinf(phs)), 1);
+	oled_refresh(0);
+}
+#endif
+
+#if defined(SCOPE) || defined(SPECTRUM)
+/*
+ * scope or spectrum view
+ */
+static void task_view(void)
+{
+#ifdef SCOPE
+	scope_update();
+#else
+	spectrum_update();
+#endif
+}
+#else
+/*
+ * report threshold events
+ */
+static void task_evt(void)
+{
+	ADC_Event evt;
+
+	while(ADC_EventGet(&evt))
+#ifdef BINLOG
+		BLOG("evt %d type %d val %d @ %u", evt.src, evt.type,
+			evt.value, (uint32_t)evt.cycles);
+#else
+		printf("\nevt %d type %d val %d @ %llu us\n\r", evt.src, evt.type,
+			evt.value, cyc_to_us(evt.cycles));
+#endif
+}
+
+/*
+ * ADC readings & hum - all from the same filter update
+ */
+static void task_lcd(void)
+{
+	ADC_Snapshot snap;
+	char txtbuf[32];
+	uint8_t i;
+
+	ADC_GetSnapshot(&snap);
+	for(i=0;i<snap.num;i++)
+	{
+		snprintf(txtbuf, sizeof(txtbuf), "%1d:%4d %4dmV", i,
+			snap.chl[i], ADC_CAL_MV(ADC_CalGetMv(i)));
+		ST7735_drawstr(0, 8*(i+1), txtbuf, ST7735_YELLOW, ST7735_BLACK);
+	}
+
+	/* no hum line if its detector didn't fit */
+	if(main_hum == GOERTZEL_NONE)
+		return;
+	snprintf(txtbuf, sizeof(txtbuf), "hum %4d %c", goertzel_get_mag(main_hum),
+		goertzel_get_det(main_hum) ? '*' : ' ');
+	ST7735_drawstr(0, 8*(i+2), txtbuf, ST7735_CYAN, ST7735_BLACK);
+}
+
+/*
+ * battery - it changes slowly
+ */
+static void task_bat(void)
+{
+	char txtbuf[32];
+
+	snprintf(txtbuf, sizeof(txtbuf), "bat %4dmV %3d%%",
+		ADC_CalGetBattMv(), ADC_CalGetSoc());
+	ST7735_drawstr(0, 8*(main_rows+1), txtbuf, ST7735_CYAN, ST7735_BLACK);
+}
+#endif
+
 /**
   * @brief System Clock Configuration
   * @retval None
@@ -76,13 +231,138 @@ void SystemClock_Config(void)
   }
 }
 
+/*
+ * boot steps - LED, I2C & the benchmarks are plain calls
+ */
+static uint8_t boot_led(pt_ctx *pt)
+{
+	LEDInit();
+	LEDAnimInit(1, 50);
+	LEDAnimRainbow(4000);
+	LEDAnimSetGlobal(32);
+	printf("LED initialized\n\r");
+
+	return PT_ENDED;
+}
+
+static uint8_t boot_i2c(pt_ctx *pt)
+{
+	shared_i2c_init();
+	printf("I2C initialized\n\r");
+
+	return PT_ENDED;
+}
+
+#ifdef OLED
+static uint8_t boot_oled(pt_ctx *pt)
+{
+	static pt_ctx child;
+
+	PT_BEGIN(pt);
+	PT_SPAWN(pt, &child, oled_init_pt(&child));
+	printf("OLED initialized - result = %d\n\r", child.state != PT_ENDED);
+	
+    /* test circle draw */
+    oled_Circle(0, 64, 16, 15, 1);
+    oled_refresh(0);	
+	PT_END(pt);
+}
+#endif
+
+/*
+ * seesaw reset takes 500ms - the LCD can't start before it's done
+ * since its reset pin is on the seesaw
+ */
+static uint8_t boot_seesaw(pt_ctx *pt)
+{
+	static pt_ctx child;
+
+	PT_BEGIN(pt);
+	PT_SPAWN(pt, &child, tftwing_init_pt(&child));
+	printf("TFTWing seesaw initialized - result = %d\n\r",
+		child.state != PT_ENDED);
+	main_buttons = tftwing_readButtons() & TFTWING_BUTTON_ALL;
+	PT_END(pt);
+}
+
+static uint8_t boot_lcd(pt_ctx *pt)
+{
+	static pt_ctx child;
+
+	PT_BEGIN(pt);
+	PT_SPAWN(pt, &child, ST7735_init_pt(&child));
+	ST7735_fillScreen(ST7735_BLACK);
+	ST7735_setRotation(3);
+	ST7735_drawstr(0, 0, "Hello, World!", ST7735_GREEN, ST7735_BLACK);
+	printf("TFTWing LCD initialized\n\r");
+	PT_END(pt);
+}
+
+static uint8_t boot_adc(pt_ctx *pt)
+{
+	ADC_Snapshot snap;
+
+	printf("ADC initialized - result = %d\n\r", ADC_Init());
+	ADC_GetSnapshot(&snap);
+	main_rows = snap.num;
+	
+	/* low battery warning - V_DIV below 3.4V */
+	ADC_EventAddCmp(ADC_CHANNEL_3, ADC_EVT_UNDER,
+		3400*4096/(3300*ADC_CAL_VDIV_RATIO), 40);
+	
+	/* mains hum on A2 - 0.1s blocks */
+	goertzel_benchmark();
+	main_hum = goertzel_add(1, 60, ADC_RATE_DEFAULT/10, 20);
+
+	return PT_ENDED;
+}
+
+static uint8_t boot_usb(pt_ctx *pt)
+{
+	usb_cdc_init();
+	printf("USB CDC initialized\n\r");
+
+	return PT_ENDED;
+}
+
+static uint8_t boot_bench(pt_ctx *pt)
+{
+	/* binary logging */
+	blog_benchmark();
+	
+#ifdef PRINTF_BENCHMARK
+	tfp_benchmark();
+#endif
+#ifdef SPECTRUM
+	rfft_benchmark();
+#endif
+
+	return PT_ENDED;
+}
+
+#if defined(SCOPE) || defined(SPECTRUM)
+static uint8_t boot_view(pt_ctx *pt)
+{
+#ifdef SCOPE
+	/* scope on A2 */
+	scope_init(ADC_CHANNEL_6);
+	printf("Scope initialized\n\r");
+#else
+	/* spectrum on A2 */
+	spectrum_init(ADC_CHANNEL_6);
+	printf("Spectrum initialized\n\r");
+#endif
+
+	return PT_ENDED;
+}
+#endif
+
 /*
  * main routine
  */
 int main(void)
 {
-	uint8_t cnt = 0, i;
-	char txtbuf[32];
+	int8_t i2c, seesaw, adc, lcd;
 	
 	/* Reset of all peripherals, Initializes the Flash interface and the Systick. */
 	HAL_Init();
@@ -93,6 +373,7 @@ int main(void)
 	/* init the UART for diagnostics */
 	setup_usart();
 	init_printf(0,usart_putc);
+	usart_set_policy(USART_TX_BLOCK);
 	printf("\n\n\rF405 Feather Blink\n\r");
 	printf("\n");
 	printf("SYSCLK = %d\n\r", HAL_RCC_GetSysClockFreq());
@@ -100,81 +381,64 @@ int main(void)
 	
 	/* start cycle timer */
 	cyccnt_enable();
+	idle_init();
+	prof_init();
+	pcsamp_init();
 	printf("Cycle Counter initialized\n\r");
 
-	/* initialize LED */
-	LEDInit();
-	printf("LED initialized\n\r");
-	
-	/* I2C */
-	shared_i2c_init();
-	printf("I2C initialized\n\r");
-	
+	/* init steps - independent ones overlap their waits */
+	boot_add("led", boot_led, 0);
+	i2c = boot_add("i2c", boot_i2c, 0);
 #ifdef OLED
-	/* OLED */
-	printf("OLED initialized - result = %d\n\r", oled_init());
-	
-    /* test circle draw */
-    oled_Circle(0, 64, 16, 15, 1);
-    oled_refresh(0);	
+	boot_add("oled", boot_oled, BOOT_DEP(i2c));
 #endif
+	seesaw = boot_add("seesaw", boot_seesaw, BOOT_DEP(i2c));
+	adc = boot_add("adc", boot_adc, 0);
+	boot_add("usb", boot_usb, 0);
+	boot_add("bench", boot_bench, 0);
+	lcd = boot_add("lcd", boot_lcd, BOOT_DEP(seesaw));
+#if defined(SCOPE) || defined(SPECTRUM)
+	boot_add("view", boot_view, BOOT_DEP(adc) | BOOT_DEP(lcd));
+#else
+	(void)adc;
+	(void)lcd;
+#endif
+	boot_run();
+	boot_report();
 
-	/* TFTWing seesaw */
-	printf("TFTWing seesaw initialized - result = %d\n\r", tftwing_init());
-	
-	/* TFTWing LCD */
-	ST7735_init();
-	ST7735_fillScreen(ST7735_BLACK);
-	ST7735_setRotation(3);
-	ST7735_drawstr(0, 0, "Hello, World!", ST7735_GREEN, ST7735_BLACK);
-	printf("TFTWing LCD initialized\n\r");
-	
-	/* ADC */
-	printf("ADC initialized - result = %d\n\r", ADC_Init());
+#ifdef USB_CONSOLE
+	init_printf(0,usb_cdc_putc);
+	shell_set_input(usb_cdc_read);
+#endif
 	
-    /* Infinite loop */
-    while(1)
-    {
-		/* update color */
-		LEDSetIdx(cnt>>4);
-		
-		/* blink red */
-		LEDToggle();
-		
+	/* command shell */
+	shell_init();
+	shell_register("btn", "TFTWing button state", main_btn);
+
+	/* tasks */
+	sched_add("led", task_led, 10, 0, 0);
+	sched_add("shell", task_shell, 100, 1, IDLE_EV_RX);
+	sched_add("btn", task_btn, 20, 2, 0);
 #ifdef OLED
-		/* sweep radar */
-		float32_t phs = 6.2832F*(float32_t)cnt/256.0F;
-		oled_line(0, 64, 16, 64+floorf(13.0F*cosf(phs)),
-			16-floorf(13.0F*sinf(phs)), 0);
-		cnt++;
-		phs = 6.2832F*(float32_t)cnt/256.0F;
-		oled_line(0, 64, 16, 64+floorf(13.0F*cosf(phs)),
-			16-floorf(13.0F*sinf(phs)), 1);
-		oled_refresh(0);
+	sched_add("radar", task_radar, 20, 3, 0);
+#endif
+#if defined(SCOPE) || defined(SPECTRUM)
+	sched_add("view", task_view, 10, 4, 0);
 #else
-		cnt++;
+	sched_set_deadline(sched_add("evt", task_evt, 0, 2, IDLE_EV_ADC), 10);
+	sched_add("lcd", task_lcd, 100, 4, 0);
+	sched_add("bat", task_bat, 1000, 5, 0);
 #endif
-		
-		/* update buttons */
-		printf("tftwing buttons = 0x%02X\r", tftwing_readButtons());
-		
-		/* update ADC readings */
-		for(i=0;i<5;i++)
-		{
-			sprintf(txtbuf, "%1d:%4d", i, ADC_GetChl(i));
-			ST7735_drawstr(0, 8*(i+1), txtbuf, ST7735_YELLOW, ST7735_BLACK);
-		}
-		
-		/* delay */
-		HAL_Delay(10);
-    }
+	printf("Scheduler started\n\r");
+	sched_run();
 }
 
 /*
  * needed by HAL
  */
-void SysTick_Handler(void)
+IRQSTAT_HANDLER(SysTick_Handler)
 {
   HAL_IncTick();
+  cyccnt64_tick();
 }
 
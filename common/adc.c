@@ -3,17 +3,75 @@
  */
 
 #include "adc.h"
+#include "decimate.h"
+#include "adc_capture.h"
+#include "adc_cal.h"
+#include "adc_event.h"
+#include "goertzel.h"
+#include "irqstat.h"
+#include "cyclesleep.h"
 
 ADC_HandleTypeDef hadc1;
 DMA_HandleTypeDef hdma_adc1;
 
-uint16_t adc_rawbuf[ADC_NUMCHLS], adc_procbuf[ADC_NUMCHLS];
+/* ADC clock is PCLK2/4 = 21MHz */
+#define ADC_CLKPRE ADC_CLOCK_SYNC_PCLK_DIV4
 
-#define OS_RATIO 32
-#define OS_SHIFT 5
-int32_t adc_acc[ADC_NUMCHLS];
-uint16_t adc_dly[ADC_NUMCHLS][OS_RATIO];
-uint16_t adc_dly_ptr;
+/* DMA double buffer - two halves of ADC_BLOCKSZ scans of adc_numchls */
+uint16_t adc_rawbuf[2*ADC_BLOCKSZ*ADC_MAXCHLS], adc_procbuf[ADC_MAXCHLS];
+int32_t adc_q31buf[ADC_MAXCHLS];
+uint32_t adc_rate;
+
+/* current scan sequence */
+ADC_ChlConf adc_conf[ADC_MAXCHLS];
+uint8_t adc_numchls;
+uint32_t adc_scancyc;
+
+/* ADC sample times in cycles, indexed by ADC_SAMPLETIME_x */
+const uint16_t adc_smp_cyc[8] = {3, 15, 28, 56, 84, 112, 144, 480};
+
+/* presets - internal channels need >= 10us sampling */
+const ADC_ChlConf adc_preset_default[] =
+{
+	{ADC_CHANNEL_3,  ADC_SAMPLETIME_28CYCLES},	// V_DIV
+	{ADC_CHANNEL_6,  ADC_SAMPLETIME_28CYCLES},	// A2
+	{ADC_CHANNEL_7,  ADC_SAMPLETIME_28CYCLES},	// A3
+	{ADC_CHANNEL_14, ADC_SAMPLETIME_28CYCLES},	// A4
+	{ADC_CHANNEL_15, ADC_SAMPLETIME_28CYCLES},	// A5
+};
+const ADC_ChlConf adc_preset_fast[] =
+{
+	{ADC_CHANNEL_6,  ADC_SAMPLETIME_15CYCLES, 3, 2, decim_comp3[2], 3, 2},
+};
+const ADC_ChlConf adc_preset_hk[] =
+{
+	{ADC_CHANNEL_3,  ADC_SAMPLETIME_480CYCLES},
+	{ADC_CHANNEL_6,  ADC_SAMPLETIME_480CYCLES},
+	{ADC_CHANNEL_7,  ADC_SAMPLETIME_480CYCLES},
+	{ADC_CHANNEL_14, ADC_SAMPLETIME_480CYCLES},
+	{ADC_CHANNEL_15, ADC_SAMPLETIME_480CYCLES},
+	{ADC_CHANNEL_VREFINT, ADC_SAMPLETIME_480CYCLES},
+	{ADC_CHANNEL_TEMPSENSOR, ADC_SAMPLETIME_480CYCLES},
+};
+const struct
+{
+	const ADC_ChlConf *conf;
+	uint8_t num;
+	uint32_t rate;
+} adc_presets[] =
+{
+	{adc_preset_default, 5, ADC_RATE_DEFAULT},
+	{adc_preset_fast, 1, 200000},
+	{adc_preset_hk, 7, 1000},
+};
+#define ADC_NUMPRESETS (sizeof(adc_presets)/sizeof(adc_presets[0]))
+
+/* published snapshots - the DMA IRQ fills the one adc_seq doesn't point at */
+ADC_Snapshot adc_snap[2];
+volatile uint32_t adc_seq;
+
+/* per-channel decimation filters */
+decim_state adc_decim[ADC_MAXCHLS];
 
 /* Diagnostic flag */
 //#define ENABLE_ADCDIAG
@@ -25,27 +83,63 @@ uint16_t adc_dly_ptr;
 #define FLAG_1
 #endif
 
+/*
+ * get the TIM2 input clock - APB1 timers run at 2x PCLK1 when prescaled
+ */
+static uint32_t ADC_TimClk(void)
+{
+	uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+
+	if((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_HCLK_DIV1)
+		pclk1 *= 2;
+
+	return pclk1;
+}
+
+/*
+ * set up TIM2 to generate TRGO at the scan rate
+ */
+static void ADC_TimInit(uint32_t rate)
+{
+	__HAL_RCC_TIM2_CLK_ENABLE();
+
+	/* stopped, upcounting, preloaded ARR, TRGO on update */
+	TIM2->CR1 = TIM_CR1_ARPE;
+	TIM2->CR2 = TIM_CR2_MMS_1;
+	TIM2->PSC = 0;
+	TIM2->CNT = 0;
+	ADC_SetRate(rate);
+
+	/* load shadow regs - must happen before the ADC is enabled */
+	TIM2->EGR = TIM_EGR_UG;
+}
+
 /*
  * init the ADC
  */
 uint8_t ADC_Init(void)
 {
     uint8_t result = 0;
+#ifdef ENABLE_ADCDIAG
     GPIO_InitTypeDef GPIO_InitStruct = {0};
-    ADC_ChannelConfTypeDef sConfig = {0};
-    DMA_Stream_TypeDef *stream_adc1;
-    uint16_t i, j;
+#endif
+    uint16_t i;
 
-    /* init buffers */
-	for(i=0;i<ADC_NUMCHLS;i++)
+    /* init buffers - filters are set up with the scan sequence */
+	for(i=0;i<2*ADC_BLOCKSZ*ADC_MAXCHLS;i++)
+		adc_rawbuf[i] = 0;
+	for(i=0;i<ADC_MAXCHLS;i++)
 	{
-        adc_rawbuf[i] = 0;
         adc_procbuf[i] = 0;
-		adc_acc[i] = 0;
-		for(j=0;j<OS_RATIO;j++)
-			adc_dly[i][j] = 0;
+		adc_q31buf[i] = 0;
+		adc_snap[0].chl[i] = 0;
+		adc_snap[0].q31[i] = 0;
 	}
-	adc_dly_ptr = 0;
+	adc_snap[0].seq = adc_snap[0].cycles = adc_snap[0].fresh = 0;
+	adc_snap[0].num = 0;
+	adc_snap[1] = adc_snap[0];
+	adc_seq = 0;
+	adc_numchls = 0;
 
 #ifdef ENABLE_ADCDIAG
     __HAL_RCC_GPIOC_CLK_ENABLE();
@@ -58,79 +152,14 @@ uint8_t ADC_Init(void)
 	HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
 #endif
 
-    __HAL_RCC_GPIOA_CLK_ENABLE();
-    __HAL_RCC_GPIOC_CLK_ENABLE();
-    /**ADC1 GPIO Configuration
-    PA3     ------> ADC1_IN3 V_DIV
-    PA6     ------> ADC1_IN6 A2
-    PA7     ------> ADC1_IN7 A3
-    PC4     ------> ADC1_IN14 A4
-    PC5     ------> ADC1_IN15 A5
-    */
-    GPIO_InitStruct.Pin = GPIO_PIN_3|GPIO_PIN_6|GPIO_PIN_7;
-    GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-
-    GPIO_InitStruct.Pin = GPIO_PIN_4|GPIO_PIN_5;
-    HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
+    /* set up scan rate timer */
+	ADC_TimInit(ADC_RATE_DEFAULT);
 
     /* Peripheral clock enable */
     __HAL_RCC_ADC1_CLK_ENABLE();
 
-    hadc1.Instance = ADC1;
-    hadc1.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
-    hadc1.Init.Resolution = ADC_RESOLUTION_12B;
-    hadc1.Init.ScanConvMode = ENABLE;
-    hadc1.Init.ContinuousConvMode = ENABLE;
-    hadc1.Init.DiscontinuousConvMode = DISABLE;
-    hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
-    hadc1.Init.ExternalTrigConv = ADC_SOFTWARE_START;
-    hadc1.Init.DataAlign = ADC_DATAALIGN_RIGHT;
-    hadc1.Init.NbrOfConversion = ADC_NUMCHLS;
-    hadc1.Init.DMAContinuousRequests = ENABLE;
-    hadc1.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
-    if (HAL_ADC_Init(&hadc1) != HAL_OK)
-    {
-        result += 1;
-    }
-
-    /** Configure for the selected ADC regular channel its corresponding rank in the sequencer and its sample time.
-    */
-    sConfig.Channel = ADC_CHANNEL_3;
-    sConfig.Rank = 1;
-    //sConfig.SamplingTime = ADC_SAMPLETIME_480CYCLES;
-    //sConfig.SamplingTime = ADC_SAMPLETIME_144CYCLES;
-    //sConfig.SamplingTime = ADC_SAMPLETIME_84CYCLES;
-    sConfig.SamplingTime = ADC_SAMPLETIME_28CYCLES;
-    if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
-    {
-        result += 2;
-    }
-    sConfig.Channel = ADC_CHANNEL_6;
-    sConfig.Rank = 2;
-    if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
-    {
-        result += 4;
-    }
-    sConfig.Channel = ADC_CHANNEL_7;
-    sConfig.Rank = 3;
-    if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
-    {
-        result += 8;
-    }
-    sConfig.Channel = ADC_CHANNEL_14;
-    sConfig.Rank = 4;
-    if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
-    {
-        result += 16;
-    }
-    sConfig.Channel = ADC_CHANNEL_15;
-    sConfig.Rank = 5;
-    if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
-    {
-        result += 16;
-    }
+	/* ADC_GetClk reads the prescaler so it must be set before any config */
+	ADC->CCR = (ADC->CCR & ~ADC_CCR_ADCPRE) | ADC_CLKPRE;
 
     /* ADC1 DMA Init */
     __HAL_RCC_DMA2_CLK_ENABLE();
@@ -153,19 +182,73 @@ uint8_t ADC_Init(void)
 
     __HAL_LINKDMA(&hadc1,DMA_Handle,hdma_adc1);
 
-    /* set up DMA details */
+	/* DMA2_Stream0_IRQn interrupt configuration */
+	HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 6, 0);
+	HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+
+	/* watchdog at the same priority so events have a single producer */
+	HAL_NVIC_SetPriority(ADC_IRQn, 6, 0);
+	HAL_NVIC_EnableIRQ(ADC_IRQn);
+
+	/* configure and start scanning */
+	hadc1.Instance = ADC1;
+	result += ADC_SetMode(ADC_MODE_DEFAULT);
+
+    return result;
+}
+
+/*
+ * configure ADC1 for timer-triggered scans and start the DMA & timer
+ */
+uint8_t ADC_Start(void)
+{
+    uint8_t result = 0, i, inputs[ADC_MAXCHLS];
+    ADC_ChannelConfTypeDef sConfig = {0};
+    DMA_Stream_TypeDef *stream_adc1;
+
+    hadc1.Instance = ADC1;
+    hadc1.Init.ClockPrescaler = ADC_CLKPRE;
+    hadc1.Init.Resolution = ADC_RESOLUTION_12B;
+    hadc1.Init.ScanConvMode = ENABLE;
+    hadc1.Init.ContinuousConvMode = DISABLE;
+    hadc1.Init.DiscontinuousConvMode = DISABLE;
+    hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+    hadc1.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T2_TRGO;
+    hadc1.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+    hadc1.Init.NbrOfConversion = adc_numchls;
+    hadc1.Init.DMAContinuousRequests = ENABLE;
+    hadc1.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+    if (HAL_ADC_Init(&hadc1) != HAL_OK)
+    {
+        result += 1;
+    }
+
+    /* regular sequence from the channel table */
+	for(i=0;i<adc_numchls;i++)
+	{
+		sConfig.Channel = adc_conf[i].chl;
+		sConfig.Rank = i+1;
+		sConfig.SamplingTime = adc_conf[i].smp;
+		if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+		{
+			result += 2;
+			break;
+		}
+		inputs[i] = adc_conf[i].chl;
+	}
+
+    /* set up DMA details - halfwords from ADC1 DR */
 	stream_adc1 = hdma_adc1.Instance;
-	stream_adc1->CR &= (uint32_t)(~DMA_SxCR_DBM);
-	stream_adc1->NDTR = (uint32_t)ADC_NUMCHLS;
+	stream_adc1->CR &= (uint32_t)(~(DMA_SxCR_DBM | DMA_SxCR_PSIZE |
+		DMA_SxCR_MSIZE));
+	stream_adc1->CR |= DMA_PDATAALIGN_HALFWORD | DMA_MDATAALIGN_HALFWORD;
+	stream_adc1->NDTR = (uint32_t)(2*ADC_BLOCKSZ*adc_numchls);
 	stream_adc1->PAR = (uint32_t)&hadc1.Instance->DR;
 	stream_adc1->M0AR = (uint32_t)&adc_rawbuf;
 
-	/* Enable the DMA transfer complete interrupt */
-	__HAL_DMA_ENABLE_IT(&hdma_adc1, DMA_IT_TC);
-
-	/* DMA2_Stream0_IRQn interrupt configuration */
-	HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 6, 0);
-	HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+	/* Enable the DMA half & transfer complete interrupts */
+	__HAL_DMA_CLEAR_FLAG(&hdma_adc1, DMA_FLAG_HTIF0_4 | DMA_FLAG_TCIF0_4);
+	__HAL_DMA_ENABLE_IT(&hdma_adc1, DMA_IT_HT | DMA_IT_TC);
 
     /* Enable ADC DMA requests */
     SET_BIT(hadc1.Instance->CR2, ADC_CR2_DMA);
@@ -173,13 +256,359 @@ uint8_t ADC_Init(void)
 	/* Enable DMA */
 	__HAL_DMA_ENABLE(&hdma_adc1);
 
-	/* enable ADC */
+	/* enable ADC - conversions wait for the timer */
     __HAL_ADC_ENABLE(&hadc1);
-    hadc1.Instance->CR2 |= ADC_CR2_SWSTART;
+
+	/* VREFINT tracking - needs a 480 cycle gap if it's not in the scan */
+	ADC_CalStart(adc_numchls, inputs, ADC_GetClk() / adc_rate >=
+		adc_scancyc + ADC_ConvCycles(ADC_SAMPLETIME_480CYCLES));
+
+	/* threshold watchdog */
+	ADC_EventStart();
+
+	/* DMA IRQ latency - TIM2 restarts with the scan that completes a half */
+	IRQSTAT_LATENCY(DMA2_Stream0_IRQn, TIM2,
+		SystemCoreClock / (2*HAL_RCC_GetPCLK1Freq()),
+		adc_scancyc * (SystemCoreClock / ADC_GetClk()));
+
+	/* start the scan rate timer */
+	TIM2->CNT = 0;
+	TIM2->CR1 |= TIM_CR1_CEN;
 
     return result;
 }
 
+/*
+ * stop scanning & release ADC1 and its DMA stream
+ */
+void ADC_Stop(void)
+{
+	/* stop triggers - TIM2 no longer tracks the DMA IRQ, e.g. in a capture */
+	TIM2->CR1 &= ~TIM_CR1_CEN;
+	IRQSTAT_LATENCY(DMA2_Stream0_IRQn, NULL, 0, 0);
+
+	/* shut down ADC & DMA requests */
+    __HAL_ADC_DISABLE(&hadc1);
+    CLEAR_BIT(hadc1.Instance->CR2, ADC_CR2_DMA);
+
+	/* stop DMA and wait for it to finish */
+	__HAL_DMA_DISABLE(&hdma_adc1);
+	while(hdma_adc1.Instance->CR & DMA_SxCR_EN)
+	{
+	}
+	__HAL_DMA_CLEAR_FLAG(&hdma_adc1, DMA_FLAG_HTIF0_4 | DMA_FLAG_TCIF0_4);
+}
+
+/*
+ * ADC clock in Hz
+ */
+uint32_t ADC_GetClk(void)
+{
+	return HAL_RCC_GetPCLK2Freq() /
+		(2*(((ADC->CCR & ADC_CCR_ADCPRE) >> ADC_CCR_ADCPRE_Pos) + 1));
+}
+
+/*
+ * ADC clocks per conversion - sampling plus 12 for 12 bits
+ */
+uint16_t ADC_ConvCycles(uint8_t smp)
+{
+	return adc_smp_cyc[smp & 7] + 12;
+}
+
+/*
+ * configure the pin for an ADC channel as analog - internal ones have none
+ */
+void ADC_ChlPin(uint8_t chl)
+{
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+	GPIO_TypeDef *port;
+
+	/* IN0-7 are PA0-7, IN8-9 are PB0-1, IN10-15 are PC0-5 */
+	if(chl < 8)
+	{
+		__HAL_RCC_GPIOA_CLK_ENABLE();
+		port = GPIOA;
+	}
+	else if(chl < 10)
+	{
+		__HAL_RCC_GPIOB_CLK_ENABLE();
+		port = GPIOB;
+		chl -= 8;
+	}
+	else if(chl < 16)
+	{
+		__HAL_RCC_GPIOC_CLK_ENABLE();
+		port = GPIOC;
+		chl -= 10;
+	}
+	else
+		return;
+
+    GPIO_InitStruct.Pin = 1<<chl;
+    GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    HAL_GPIO_Init(port, &GPIO_InitStruct);
+}
+
+/*
+ * stop, load a new scan sequence & rate and restart. Each channel gets
+ * its own filter, or the default one if order is 0. Fails without
+ * touching the running scan if the sequence doesn't fit in the rate, a
+ * filter is invalid or capture owns ADC1.
+ */
+uint8_t ADC_Config(const ADC_ChlConf *conf, uint8_t num, uint32_t rate)
+{
+	ADC_ChlConf c[ADC_MAXCHLS];
+	decim_state test;
+	uint32_t cyc = 0;
+	uint8_t i;
+
+	if((num < 1) || (num > ADC_MAXCHLS) || (rate == 0) || ADC_CapBusy())
+		return 1;
+
+	for(i=0;i<num;i++)
+	{
+		c[i] = conf[i];
+		if(!c[i].order)
+		{
+			c[i].order = ADC_CIC_ORDER;
+			c[i].log2r = ADC_CIC_LOG2R;
+			c[i].coeffs = decim_comp3[ADC_CIC_ORDER-1];
+			c[i].ntaps = 3;
+			c[i].fir_decim = 2;
+		}
+		if((c[i].chl > 18) || decim_init(&test, c[i].order, c[i].log2r,
+			c[i].coeffs, c[i].ntaps, c[i].fir_decim))
+			return 1;
+		cyc += ADC_ConvCycles(c[i].smp);
+	}
+
+	/* whole scan must finish before the next trigger */
+	if((uint64_t)cyc * rate > ADC_GetClk())
+		return 1;
+
+	ADC_Stop();
+	HAL_NVIC_DisableIRQ(DMA2_Stream0_IRQn);
+
+	for(i=0;i<num;i++)
+	{
+		adc_conf[i] = c[i];
+		decim_init(&adc_decim[i], c[i].order, c[i].log2r, c[i].coeffs,
+			c[i].ntaps, c[i].fir_decim);
+		adc_procbuf[i] = 0;
+		adc_q31buf[i] = 0;
+		ADC_ChlPin(c[i].chl);
+	}
+	adc_numchls = num;
+	adc_scancyc = cyc;
+	ADC_SetRate(rate);
+	TIM2->EGR = TIM_EGR_UG;
+
+	HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+
+	return ADC_Start();
+}
+
+/*
+ * switch to one of the preset scans
+ */
+uint8_t ADC_SetMode(uint8_t mode)
+{
+	if(mode >= ADC_NUMPRESETS)
+		return 1;
+
+	return ADC_Config(adc_presets[mode].conf, adc_presets[mode].num,
+		adc_presets[mode].rate);
+}
+
+/*
+ * append a channel with the default filter at the current rate
+ */
+uint8_t ADC_AddChl(uint8_t chl, uint8_t smp)
+{
+	ADC_ChlConf conf[ADC_MAXCHLS];
+	uint8_t i;
+
+	if(adc_numchls >= ADC_MAXCHLS)
+		return 1;
+
+	for(i=0;i<adc_numchls;i++)
+		conf[i] = adc_conf[i];
+	conf[i].chl = chl;
+	conf[i].smp = smp;
+	conf[i].order = 0;
+
+	return ADC_Config(conf, adc_numchls+1, adc_rate);
+}
+
+/*
+ * drop the channel at sequence index idx - later ones move down
+ */
+uint8_t ADC_RemoveChl(uint8_t idx)
+{
+	ADC_ChlConf conf[ADC_MAXCHLS];
+	uint8_t i, j = 0;
+
+	if(idx >= adc_numchls)
+		return 1;
+
+	for(i=0;i<adc_numchls;i++)
+		if(i != idx)
+			conf[j++] = adc_conf[i];
+
+	return ADC_Config(conf, j, adc_rate);
+}
+
+/*
+ * change the sample time of the channel at sequence index idx
+ */
+uint8_t ADC_SetSmpTime(uint8_t idx, uint8_t smp)
+{
+	ADC_ChlConf conf[ADC_MAXCHLS];
+	uint8_t i;
+
+	if(idx >= adc_numchls)
+		return 1;
+
+	for(i=0;i<adc_numchls;i++)
+		conf[i] = adc_conf[i];
+	conf[idx].smp = smp;
+
+	return ADC_Config(conf, adc_numchls, adc_rate);
+}
+
+/*
+ * change the scan rate with the same checks as a new sequence - fails
+ * if the scan doesn't fit in the rate
+ */
+uint8_t ADC_ChangeRate(uint32_t rate)
+{
+	ADC_ChlConf conf[ADC_MAXCHLS];
+	uint8_t i;
+
+	for(i=0;i<adc_numchls;i++)
+		conf[i] = adc_conf[i];
+
+	return ADC_Config(conf, adc_numchls, rate);
+}
+
+/*
+ * number of channels in the scan
+ */
+uint8_t ADC_GetNumChls(void)
+{
+	return adc_numchls;
+}
+
+/*
+ * ADC input of the channel at sequence index idx
+ */
+uint8_t ADC_GetChlInput(uint8_t idx)
+{
+	return adc_conf[idx].chl;
+}
+
+/*
+ * raw sample of ADC input chl from n scans back in the DMA buffer, 0 is
+ * the newest complete one. Returns ADC_RAW_NONE if chl isn't scanned or
+ * n reaches the scan the DMA is about to overwrite.
+ */
+uint16_t ADC_GetRawRecent(uint8_t chl, uint8_t n)
+{
+	uint32_t total = 2*ADC_BLOCKSZ*adc_numchls, pos, scan;
+	uint8_t idx;
+
+	for(idx=0;idx<adc_numchls;idx++)
+		if(adc_conf[idx].chl == chl)
+			break;
+	if((idx == adc_numchls) || (n >= 2*ADC_BLOCKSZ-1))
+		return ADC_RAW_NONE;
+
+	/* next write position, the scan it's in & whether idx is done there */
+	pos = (total - hdma_adc1.Instance->NDTR) % total;
+	scan = pos / adc_numchls + 2*ADC_BLOCKSZ;
+	if(idx >= pos % adc_numchls)
+		scan--;
+	scan = (scan - n) % (2*ADC_BLOCKSZ);
+
+	return adc_rawbuf[scan*adc_numchls + idx];
+}
+
+/*
+ * set the scan rate in Hz - returns the actual rate achieved
+ */
+uint32_t ADC_SetRate(uint32_t rate)
+{
+	uint32_t clk = ADC_TimClk(), arr;
+
+	if(rate == 0)
+		rate = 1;
+	arr = (clk + rate/2) / rate;
+	if(arr < 2)
+		arr = 2;
+
+	/* ARR is preloaded so takes effect at the next update */
+	TIM2->ARR = arr - 1;
+	adc_rate = clk / arr;
+
+	return adc_rate;
+}
+
+/*
+ * get the current scan rate in Hz
+ */
+uint32_t ADC_GetRate(void)
+{
+	return adc_rate;
+}
+
+/*
+ * set up the decimation chain for one channel
+ * coeffs are Q30, ntaps = 0 bypasses the FIR
+ */
+uint8_t ADC_SetFilter(uint8_t chl, uint8_t order, uint8_t log2r,
+	const int32_t *coeffs, uint8_t ntaps, uint8_t fir_decim)
+{
+	uint8_t result;
+
+	if(chl >= adc_numchls)
+		return 1;
+
+	/* keep the block filter off the state while we change it */
+	HAL_NVIC_DisableIRQ(DMA2_Stream0_IRQn);
+	result = decim_init(&adc_decim[chl], order, log2r, coeffs, ntaps,
+		fir_decim);
+	if(!result)
+	{
+		/* remember it across sequence changes */
+		adc_conf[chl].order = order;
+		adc_conf[chl].log2r = log2r;
+		adc_conf[chl].coeffs = coeffs;
+		adc_conf[chl].ntaps = ntaps;
+		adc_conf[chl].fir_decim = fir_decim;
+	}
+	HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+
+	return result;
+}
+
+/*
+ * output rate of a channel in Hz
+ */
+uint32_t ADC_GetChlRate(uint8_t chl)
+{
+	return adc_rate / decim_ratio(&adc_decim[chl]);
+}
+
+/*
+ * output width of a channel in bits
+ */
+uint8_t ADC_GetChlBits(uint8_t chl)
+{
+	return decim_bits(&adc_decim[chl]);
+}
+
 /*
  * get ADC data from processed buffer
  */
@@ -188,34 +617,130 @@ uint16_t ADC_GetChl(uint8_t chl)
     return adc_procbuf[chl];
 }
 
-void DMA2_Stream0_IRQHandler(void)
+/*
+ * get full resolution ADC data - Q31 with full scale at 1.0
+ */
+int32_t ADC_GetChlQ31(uint8_t chl)
 {
-    uint8_t i;
+    return adc_q31buf[chl];
+}
 
-	FLAG_1;
+/*
+ * get all channels from a single filter update without masking IRQs.
+ * Copies the published half of the snapshot pair and retries if the
+ * DMA IRQ published again meanwhile, so it's also safe from a higher
+ * priority IRQ. Returns the sequence number.
+ */
+uint32_t ADC_GetSnapshot(ADC_Snapshot *snap)
+{
+	uint32_t seq;
 
-	/* Transfer complete interrupt */
-	if (__HAL_DMA_GET_FLAG(&hdma_adc1, DMA_FLAG_TCIF0_4) != RESET)
+	do
 	{
-		/* Clear the Interrupt flag */
-		__HAL_DMA_CLEAR_FLAG(&hdma_adc1, DMA_FLAG_TCIF0_4);
+		seq = adc_seq;
+		__DMB();
+		*snap = adc_snap[seq & 1];
+		__DMB();
+	}
+	while(seq != adc_seq);
 
-		/* filter raw buffer to holding buffer */
-		for(i=0;i<ADC_NUMCHLS;i++)
+	return seq;
+}
+
+/*
+ * filter one block of scans into the processed buffer
+ */
+static void ADC_ProcBlock(uint16_t *blk)
+{
+	uint64_t cycles = cyccnt64();
+	uint32_t seq;
+	uint16_t fresh = 0;
+	uint8_t i;
+	int32_t q;
+	ADC_Snapshot *snap;
+
+	/* threshold comparators see every raw sample */
+	ADC_EventBlock(blk, adc_numchls, cycles, SystemCoreClock / adc_rate);
+
+	/* tone detectors */
+	goertzel_block(blk, adc_numchls, ADC_BLOCKSZ);
+
+	for(i=0;i<adc_numchls;i++)
+	{
+		/* decimate one channel of the interleaved block */
+		if(decim_block(&adc_decim[i], &blk[i], adc_numchls, ADC_BLOCKSZ))
 		{
-			/* add new, subtract old to acc */
-			adc_acc[i] -= adc_dly[i][adc_dly_ptr];
-			adc_acc[i] += adc_rawbuf[i];
+			q = adc_decim[i].out;
+			adc_q31buf[i] = q;
+
+			/* round & clamp to 12 bits */
+			q = (q < 0) ? 0 : (q >> 3) + (1<<15);
+			adc_procbuf[i] = __USAT(q >> 16, 12);
+			fresh |= 1<<i;
+		}
+	}
+
+	if(!fresh)
+		return;
+
+	/* supply correction & millivolts */
+	ADC_CalBlock(adc_q31buf, fresh);
+
+	/* fill the idle snapshot then flip to it */
+	seq = adc_seq + 1;
+	snap = &adc_snap[seq & 1];
+	snap->seq = seq;
+	snap->cycles = cycles;
+	snap->fresh = fresh;
+	snap->num = adc_numchls;
+	for(i=0;i<adc_numchls;i++)
+	{
+		snap->chl[i] = adc_procbuf[i];
+		snap->q31[i] = adc_q31buf[i];
+	}
+	__DMB();
+	adc_seq = seq;
+}
+
+IRQSTAT_HANDLER(DMA2_Stream0_IRQHandler)
+{
+	/* capture mode owns the stream while it's running */
+	if(ADC_CapBusy())
+	{
+		ADC_CapDMAIRQ();
+		return;
+	}
 
-			/* store new in buffer */
-			adc_dly[i][adc_dly_ptr] = adc_rawbuf[i];
+	FLAG_1;
 
-			/* normalize acc to output */
-			adc_procbuf[i] = adc_acc[i]>>OS_SHIFT;
-        }
+	/* Half transfer interrupt - first half is ready */
+	if (__HAL_DMA_GET_FLAG(&hdma_adc1, DMA_FLAG_HTIF0_4) != RESET)
+	{
+		/* Clear the Interrupt flag */
+		__HAL_DMA_CLEAR_FLAG(&hdma_adc1, DMA_FLAG_HTIF0_4);
 
-        adc_dly_ptr = (adc_dly_ptr+1)%OS_RATIO;
+		ADC_ProcBlock(&adc_rawbuf[0]);
+	}
+
+	/* Transfer complete interrupt - second half is ready */
+	if (__HAL_DMA_GET_FLAG(&hdma_adc1, DMA_FLAG_TCIF0_4) != RESET)
+	{
+		/* Clear the Interrupt flag */
+		__HAL_DMA_CLEAR_FLAG(&hdma_adc1, DMA_FLAG_TCIF0_4);
+
+		ADC_ProcBlock(&adc_rawbuf[ADC_BLOCKSZ*adc_numchls]);
     }
 
     FLAG_0;
 }
+
+/*
+ * ADC1/2/3 global interrupt - the watchdog belongs to capture while it runs
+ */
+IRQSTAT_HANDLER(ADC_IRQHandler)
+{
+	if(ADC_CapBusy())
+		ADC_CapAWDIRQ();
+	else
+		ADC_EventAWDIRQ();
+}
@@ -7,10 +7,76 @@
 
 #include "stm32f4xx_hal.h"
 
-/* Number of ADC channels we're scanning */
-#define ADC_NUMCHLS 5
+/* Max ADC channels in a scan - the length of the regular sequence */
+#define ADC_MAXCHLS 16
+
+/* Number of scans per DMA half-buffer block */
+#define ADC_BLOCKSZ 32
+
+/* no such raw sample */
+#define ADC_RAW_NONE 0xFFFF
+
+/* Default scan rate in Hz - set by TIM2 TRGO */
+#define ADC_RATE_DEFAULT 10000
+
+/* Default decimation - 3rd order CIC by 16 then 3-tap FIR by 2 */
+#define ADC_CIC_ORDER 3
+#define ADC_CIC_LOG2R 4
+
+/* scan presets */
+enum adc_mode
+{
+	ADC_MODE_DEFAULT,		// V_DIV & A2-A5 at 10kHz
+	ADC_MODE_FAST,			// A2 alone at 200kHz
+	ADC_MODE_HOUSEKEEPING,	// V_DIV, A2-A5, VREFINT & temp at 1kHz
+};
+
+/* one entry in the scan sequence - order 0 selects the default filter */
+typedef struct
+{
+	uint8_t chl;			/* ADC_CHANNEL_x */
+	uint8_t smp;			/* ADC_SAMPLETIME_x */
+	uint8_t order;			/* CIC order & log2 of decimation */
+	uint8_t log2r;
+	const int32_t *coeffs;	/* FIR - Q30, ntaps = 0 bypasses */
+	uint8_t ntaps;
+	uint8_t fir_decim;
+} ADC_ChlConf;
+
+/* all channels as of one filter update */
+typedef struct
+{
+	uint32_t seq;		/* update count, one per block with new output */
+	uint64_t cycles;	/* cyccnt64() when the block was processed */
+	uint16_t fresh;		/* bitmask of channels updated by this block */
+	uint8_t num;		/* channels in the scan */
+	uint16_t chl[ADC_MAXCHLS];
+	int32_t q31[ADC_MAXCHLS];
+} ADC_Snapshot;
 
 uint8_t ADC_Init(void);
+uint8_t ADC_Start(void);
+void ADC_Stop(void);
+uint8_t ADC_Config(const ADC_ChlConf *conf, uint8_t num, uint32_t rate);
+uint8_t ADC_SetMode(uint8_t mode);
+uint8_t ADC_AddChl(uint8_t chl, uint8_t smp);
+uint8_t ADC_RemoveChl(uint8_t idx);
+uint8_t ADC_SetSmpTime(uint8_t idx, uint8_t smp);
+uint8_t ADC_ChangeRate(uint32_t rate);
+uint8_t ADC_GetNumChls(void);
+uint8_t ADC_GetChlInput(uint8_t idx);
+uint16_t ADC_GetRawRecent(uint8_t chl, uint8_t n);
+void ADC_ChlPin(uint8_t chl);
+uint32_t ADC_GetClk(void);
+uint16_t ADC_ConvCycles(uint8_t smp);
+uint32_t ADC_SetRate(uint32_t rate);
+uint32_t ADC_GetRate(void);
+uint8_t ADC_SetFilter(uint8_t chl, uint8_t order, uint8_t log2r,
+	const int32_t *coeffs, uint8_t ntaps, uint8_t fir_decim);
+uint32_t ADC_GetChlRate(uint8_t chl);
+uint8_t ADC_GetChlBits(uint8_t chl);
 uint16_t ADC_GetChl(uint8_t chl);
+int32_t ADC_GetChlQ31(uint8_t chl);
+uint32_t ADC_GetSnapshot(ADC_Snapshot *snap);
 
 #endif
@@ -0,0 +1,182 @@
+/*
+ * adc_cal.c - VREFINT supply correction, millivolts & battery gauge
+ *
+ * VDDA is tracked from VREFINT against its factory reading. If VREFINT
+ * isn't in the scan it's converted as an injected channel every
+ * ADC_CAL_INTERVAL blocks, but only when the scan period leaves room
+ * for the 480 cycle sample. All the work happens from ADC_ProcBlock so
+ * the getters just return the latest values.
+ */
+
+#include "adc_cal.h"
+#include "adc.h"
+
+/* no channel */
+#define CAL_NONE 0xFF
+
+/* IIR shifts - VREFINT per update, battery ~1s at the default rate */
+#define CAL_VREF_SHIFT 3
+#define CAL_BATT_SHIFT 8
+
+/* LiPo resting voltage at 0, 5 ... 100% charge */
+const uint16_t cal_soc_mv[] =
+{
+	3270, 3610, 3690, 3710, 3730, 3750, 3770, 3790, 3800, 3820, 3840,
+	3850, 3870, 3910, 3950, 3980, 4020, 4080, 4110, 4150, 4200,
+};
+#define CAL_SOC_NUM (sizeof(cal_soc_mv)/sizeof(cal_soc_mv[0]))
+
+/* state */
+uint8_t cal_vref_idx, cal_vdiv_idx, cal_inject, cal_blocks, cal_soc;
+uint32_t cal_vref_q16, cal_vrefcal, cal_batt_q16;
+int32_t cal_vdda_q16, cal_mv[ADC_MAXCHLS];
+
+/*
+ * VDDA in Q16 mV from a Q16 VREFINT reading in counts
+ */
+static void ADC_CalVdda(void)
+{
+	if(cal_vref_q16)
+		cal_vdda_q16 = ((uint64_t)ADC_CAL_VREFINT_MV * cal_vrefcal << 32) /
+			cal_vref_q16;
+}
+
+/*
+ * state of charge by interpolating the LiPo table
+ */
+static uint8_t ADC_CalSoc(uint32_t mv)
+{
+	uint8_t i;
+
+	if(mv <= cal_soc_mv[0])
+		return 0;
+	for(i=1;i<CAL_SOC_NUM;i++)
+	{
+		if(mv < cal_soc_mv[i])
+			return 5*(i-1) + 5*(mv - cal_soc_mv[i-1]) /
+				(cal_soc_mv[i] - cal_soc_mv[i-1]);
+	}
+	return 100;
+}
+
+/*
+ * called by ADC_Start with the scan inputs - slack is nonzero if a
+ * VREFINT conversion fits between scans
+ */
+void ADC_CalStart(uint8_t num, const uint8_t *inputs, uint8_t slack)
+{
+	uint8_t i;
+
+	/* unprogrammed parts get the nominal 1.21V */
+	cal_vrefcal = ADC_CAL_VREFINT_CAL;
+	if((cal_vrefcal == 0) || (cal_vrefcal == 0xFFFF))
+		cal_vrefcal = 1502;
+
+	cal_vref_idx = cal_vdiv_idx = CAL_NONE;
+	for(i=0;i<num;i++)
+	{
+		cal_mv[i] = 0;
+		if(inputs[i] == ADC_CHANNEL_VREFINT)
+			cal_vref_idx = i;
+		else if(inputs[i] == ADC_CAL_VDIV_CHL)
+			cal_vdiv_idx = i;
+	}
+
+	/* start from nominal VDDA until the first reading */
+	if(!cal_vref_q16)
+	{
+		cal_vref_q16 = cal_vrefcal << 16;
+		ADC_CalVdda();
+	}
+
+	/* injected VREFINT - JL = 0 converts JSQ4, 480 cycles */
+	cal_inject = (cal_vref_idx == CAL_NONE) && slack;
+	cal_blocks = 0;
+	if(cal_inject)
+	{
+		ADC->CCR |= ADC_CCR_TSVREFE;
+		ADC1->SMPR1 = (ADC1->SMPR1 & ~ADC_SMPR1_SMP17) |
+			(ADC_SAMPLETIME_480CYCLES << ADC_SMPR1_SMP17_Pos);
+		ADC1->JSQR = ADC_CHANNEL_VREFINT << ADC_JSQR_JSQ4_Pos;
+		ADC1->SR = ~ADC_SR_JEOC;
+		ADC1->CR2 |= ADC_CR2_JSWSTART;
+	}
+}
+
+/*
+ * update from one processed block - fresh is the mask of new outputs
+ */
+void ADC_CalBlock(const int32_t *q31, uint16_t fresh)
+{
+	uint32_t v;
+	uint8_t i;
+
+	/* VREFINT - Q31 with 4096 at 1.0 is Q16 counts after >>3 */
+	if((cal_vref_idx != CAL_NONE) && (fresh & (1<<cal_vref_idx)))
+	{
+		cal_vref_q16 += ((int32_t)(q31[cal_vref_idx] >> 3) -
+			(int32_t)cal_vref_q16) >> CAL_VREF_SHIFT;
+		ADC_CalVdda();
+	}
+	else if(cal_inject && (++cal_blocks >= ADC_CAL_INTERVAL))
+	{
+		cal_blocks = 0;
+		if(ADC1->SR & ADC_SR_JEOC)
+		{
+			ADC1->SR = ~ADC_SR_JEOC;
+			cal_vref_q16 += ((int32_t)(ADC1->JDR1 << 16) -
+				(int32_t)cal_vref_q16) >> CAL_VREF_SHIFT;
+			ADC_CalVdda();
+		}
+		ADC1->CR2 |= ADC_CR2_JSWSTART;
+	}
+
+	/* scale new outputs by VDDA */
+	for(i=0;fresh;i++,fresh>>=1)
+		if(fresh & 1)
+			cal_mv[i] = ((int64_t)q31[i] * cal_vdda_q16) >> 31;
+
+	/* battery through the divider */
+	if(cal_vdiv_idx != CAL_NONE)
+	{
+		v = cal_mv[cal_vdiv_idx] * ADC_CAL_VDIV_RATIO;
+		if(!cal_batt_q16)
+			cal_batt_q16 = v;
+		else
+			cal_batt_q16 += ((int32_t)v - (int32_t)cal_batt_q16) >>
+				CAL_BATT_SHIFT;
+		cal_soc = ADC_CalSoc(ADC_CAL_MV(cal_batt_q16));
+	}
+}
+
+/*
+ * VDDA in Q16 mV
+ */
+int32_t ADC_CalGetVdda(void)
+{
+	return cal_vdda_q16;
+}
+
+/*
+ * channel at sequence index chl in Q16 mV
+ */
+int32_t ADC_CalGetMv(uint8_t chl)
+{
+	return cal_mv[chl];
+}
+
+/*
+ * filtered battery voltage in mV
+ */
+uint16_t ADC_CalGetBattMv(void)
+{
+	return ADC_CAL_MV(cal_batt_q16);
+}
+
+/*
+ * battery state of charge in percent
+ */
+uint8_t ADC_CalGetSoc(void)
+{
+	return cal_soc;
+}
@@ -0,0 +1,31 @@
+/*
+ * adc_cal.h - VREFINT supply correction, millivolts & battery gauge
+ */
+
+#ifndef __adc_cal__
+#define __adc_cal__
+
+#include "stm32f4xx_hal.h"
+
+/* factory VREFINT reading taken at VDDA = 3.3V */
+#define ADC_CAL_VREFINT_CAL (*(const uint16_t *)0x1FFF7A2A)
+#define ADC_CAL_VREFINT_MV 3300
+
+/* scan blocks between injected VREFINT conversions */
+#define ADC_CAL_INTERVAL 16
+
+/* battery sense - V_DIV is VBAT through a 1:2 divider */
+#define ADC_CAL_VDIV_CHL ADC_CHANNEL_3
+#define ADC_CAL_VDIV_RATIO 2
+
+/* calibrated readings are millivolts in Q16 */
+#define ADC_CAL_MV(q16) ((q16) >> 16)
+
+void ADC_CalStart(uint8_t num, const uint8_t *inputs, uint8_t slack);
+void ADC_CalBlock(const int32_t *q31, uint16_t fresh);
+int32_t ADC_CalGetVdda(void);
+int32_t ADC_CalGetMv(uint8_t chl);
+uint16_t ADC_CalGetBattMv(void);
+uint8_t ADC_CalGetSoc(void);
+
+#endif
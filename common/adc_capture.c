@@ -0,0 +1,330 @@
+/*
+ * adc_capture.c - high-speed interleaved single-channel ADC capture
+ *
+ * Borrows ADC1 and its DMA stream from the scanner, ganging ADC1/2/3 in
+ * triple interleaved mode for channels shared by all three ADCs (IN0-3,
+ * IN10-13) or ADC1/2 in dual interleaved mode for the rest (A2-A5 are
+ * IN6, IN7, IN14, IN15 which ADC3 can't reach). At 21MHz ADCCLK with the
+ * minimum 3 cycle sample time that gives 4.2MSPS triple / 2.6MSPS dual.
+ * Longer sample times run ADC1 alone for slower captures down to 42.7kSPS.
+ *
+ * Data streams through ADC_CDR in DMA mode 2 into a circular ring. Once
+ * pre-trigger history has accumulated the trigger is armed, and after the
+ * trigger the ring keeps filling until at least the post-trigger depth has
+ * been written, at which point conversions stop at a half-buffer boundary.
+ */
+
+#include "adc_capture.h"
+#include "adc.h"
+
+extern DMA_HandleTypeDef hdma_adc1;
+
+/* capture ring - DMA can't reach CCM so this lives in main RAM */
+uint16_t cap_buf[ADC_CAP_BUFSZ] __attribute__ ((aligned (4)));
+
+/* capture state */
+volatile uint8_t cap_state = ADC_CAP_IDLE;
+uint8_t cap_chl, cap_trig, cap_swtrig, cap_per_item;
+uint16_t cap_pre, cap_post;
+uint32_t cap_trig_pos, cap_last, cap_count, cap_rate;
+void (*cap_cb)(void);
+
+/*
+ * single channel, continuous, minimum sample time
+ */
+static void ADC_CapCfgOne(ADC_TypeDef *adc, uint8_t chl, uint8_t smp)
+{
+	adc->CR1 = 0;
+	adc->CR2 = ADC_CR2_CONT;
+	adc->SQR1 = 0;
+	adc->SQR3 = chl;
+	if(chl < 10)
+		adc->SMPR2 = (adc->SMPR2 & ~(ADC_SMPR2_SMP0 << (3*chl))) |
+			(smp << (3*chl));
+	else
+		adc->SMPR1 = (adc->SMPR1 & ~(ADC_SMPR1_SMP10 << (3*(chl-10)))) |
+			(smp << (3*(chl-10)));
+}
+
+/*
+ * shut down conversions & DMA - leaves data in the ring
+ */
+static void ADC_CapHalt(void)
+{
+	ADC1->CR2 &= ~ADC_CR2_ADON;
+	ADC2->CR2 &= ~ADC_CR2_ADON;
+	ADC3->CR2 &= ~ADC_CR2_ADON;
+	ADC1->CR1 &= ~(ADC_CR1_AWDIE | ADC_CR1_AWDEN | ADC_CR1_AWDSGL |
+		ADC_CR1_AWDCH);
+	__HAL_DMA_DISABLE(&hdma_adc1);
+}
+
+/*
+ * latch the trigger position - called with the DMA IRQ masked
+ */
+static void ADC_CapLatch(void)
+{
+	ADC1->CR1 &= ~ADC_CR1_AWDIE;
+	cap_trig_pos = (ADC_CAP_BUFSZ - cap_per_item*hdma_adc1.Instance->NDTR) &
+		(ADC_CAP_BUFSZ-1);
+	cap_last = cap_trig_pos;
+	cap_count = 0;
+	cap_state = ADC_CAP_POST;
+}
+
+/*
+ * start a capture on ADC channel chl with pre/post trigger depth in
+ * samples. smp is an ADC_SAMPLETIME_x code - only the 3 cycle minimum
+ * interleaves. lo/hi are the analog watchdog window for ADC_CAP_TRIG_AWD.
+ * cb is called from IRQ when the capture completes.
+ */
+uint8_t ADC_CapStart(uint8_t chl, uint8_t smp, uint16_t pre, uint16_t post,
+	uint8_t trig, uint16_t lo, uint16_t hi, void (*cb)(void))
+{
+	DMA_Stream_TypeDef *stream = hdma_adc1.Instance;
+	uint32_t triple, multi, adcclk;
+
+	if((chl > 15) || (smp > ADC_SAMPLETIME_480CYCLES) ||
+		(pre + post > ADC_CAP_MAXDEPTH) || (post == 0))
+		return 1;
+
+	/* take over ADC1 & DMA from the scanner */
+	HAL_NVIC_DisableIRQ(DMA2_Stream0_IRQn);
+	if(cap_state == ADC_CAP_IDLE)
+		ADC_Stop();
+	else
+		ADC_CapHalt();
+	while(stream->CR & DMA_SxCR_EN)
+	{
+	}
+	__HAL_DMA_CLEAR_FLAG(&hdma_adc1, DMA_FLAG_HTIF0_4 | DMA_FLAG_TCIF0_4);
+
+	cap_chl = chl;
+	cap_pre = pre;
+	cap_post = post;
+	cap_trig = trig;
+	cap_swtrig = 0;
+	cap_cb = cb;
+	cap_state = ADC_CAP_FILL;
+
+	ADC_ChlPin(chl);
+	__HAL_RCC_ADC2_CLK_ENABLE();
+	__HAL_RCC_ADC3_CLK_ENABLE();
+
+	/* ADC3 can only join in on IN0-3 & IN10-13 */
+	multi = (smp == ADC_SAMPLETIME_3CYCLES);
+	triple = multi && ((chl < 4) || ((chl >= 10) && (chl < 14)));
+
+	ADC_CapCfgOne(ADC1, chl, smp);
+	if(multi)
+		ADC_CapCfgOne(ADC2, chl, smp);
+	if(triple)
+		ADC_CapCfgOne(ADC3, chl, smp);
+
+	/* analog watchdog on the master - interrupt enabled once armed */
+	if(trig == ADC_CAP_TRIG_AWD)
+	{
+		ADC1->HTR = hi;
+		ADC1->LTR = lo;
+		ADC1->CR1 |= ADC_CR1_AWDEN | ADC_CR1_AWDSGL | chl;
+		ADC1->SR = ~ADC_SR_AWD;
+	}
+
+	adcclk = ADC_GetClk();
+	stream->CR &= (uint32_t)(~(DMA_SxCR_DBM | DMA_SxCR_PSIZE |
+		DMA_SxCR_MSIZE));
+	stream->M0AR = (uint32_t)cap_buf;
+	ADC->CCR &= ADC_CCR_ADCPRE | ADC_CCR_TSVREFE | ADC_CCR_VBATE;
+
+	if(multi)
+	{
+		/* interleave 5 cycles triple or 8 dual, DMA mode 2 */
+		ADC->CCR |= ADC_CCR_DDS | ADC_CCR_DMA_1 |
+			(triple ? (ADC_TRIPLEMODE_INTERL | (0 << ADC_CCR_DELAY_Pos)) :
+			(ADC_DUALMODE_INTERL | (3 << ADC_CCR_DELAY_Pos)));
+		cap_rate = triple ? adcclk/5 : adcclk/8;
+
+		/* word DMA from the common data register */
+		cap_per_item = 2;
+		stream->CR |= DMA_PDATAALIGN_WORD | DMA_MDATAALIGN_WORD;
+		stream->PAR = (uint32_t)&ADC->CDR;
+	}
+	else
+	{
+		/* ADC1 alone, 12 cycles conversion on top of sampling */
+		ADC1->CR2 |= ADC_CR2_DMA | ADC_CR2_DDS;
+		cap_rate = adcclk / ADC_ConvCycles(smp);
+
+		/* halfword DMA from ADC1 */
+		cap_per_item = 1;
+		stream->CR |= DMA_PDATAALIGN_HALFWORD | DMA_MDATAALIGN_HALFWORD;
+		stream->PAR = (uint32_t)&ADC1->DR;
+	}
+	stream->NDTR = ADC_CAP_BUFSZ/cap_per_item;
+	__HAL_DMA_ENABLE_IT(&hdma_adc1, DMA_IT_HT | DMA_IT_TC);
+	__HAL_DMA_ENABLE(&hdma_adc1);
+
+	HAL_NVIC_SetPriority(ADC_IRQn, 6, 0);
+	HAL_NVIC_EnableIRQ(ADC_IRQn);
+	HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+
+	/* power up slaves then master, wait tSTAB and go */
+	if(triple)
+		ADC3->CR2 |= ADC_CR2_ADON;
+	if(multi)
+		ADC2->CR2 |= ADC_CR2_ADON;
+	ADC1->CR2 |= ADC_CR2_ADON;
+	adcclk = SystemCoreClock / 1000000 * 3;
+	while(adcclk--)
+		__NOP();
+	ADC1->CR2 |= ADC_CR2_SWSTART;
+
+	return 0;
+}
+
+/*
+ * software trigger - deferred until pre-trigger history is in
+ */
+void ADC_CapTrigger(void)
+{
+	HAL_NVIC_DisableIRQ(DMA2_Stream0_IRQn);
+	if(cap_state == ADC_CAP_ARMED)
+		ADC_CapLatch();
+	else if(cap_state == ADC_CAP_FILL)
+		cap_swtrig = 1;
+	HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+}
+
+/*
+ * stop any capture and give ADC1 back to the scanner
+ */
+void ADC_CapAbort(void)
+{
+	if(cap_state == ADC_CAP_IDLE)
+		return;
+
+	HAL_NVIC_DisableIRQ(DMA2_Stream0_IRQn);
+	ADC_CapHalt();
+	while(hdma_adc1.Instance->CR & DMA_SxCR_EN)
+	{
+	}
+
+	/* back to independent mode, slaves off */
+	ADC->CCR &= ADC_CCR_ADCPRE | ADC_CCR_TSVREFE | ADC_CCR_VBATE;
+	cap_state = ADC_CAP_IDLE;
+
+	ADC_Start();
+	HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+}
+
+/*
+ * get capture state
+ */
+uint8_t ADC_CapState(void)
+{
+	return cap_state;
+}
+
+/*
+ * true while the capture owns ADC1
+ */
+uint8_t ADC_CapBusy(void)
+{
+	return cap_state != ADC_CAP_IDLE;
+}
+
+/*
+ * sample rate of the last capture in Hz
+ */
+uint32_t ADC_CapGetRate(void)
+{
+	return cap_rate;
+}
+
+/*
+ * copy a finished capture to dst in time order, returns samples copied
+ */
+uint16_t ADC_CapRead(uint16_t *dst, uint16_t len)
+{
+	uint32_t idx, i;
+
+	if(cap_state != ADC_CAP_DONE)
+		return 0;
+
+	if(len > cap_pre + cap_post)
+		len = cap_pre + cap_post;
+
+	idx = (cap_trig_pos - cap_pre) & (ADC_CAP_BUFSZ-1);
+	for(i=0;i<len;i++)
+	{
+		*dst++ = cap_buf[idx];
+		idx = (idx+1) & (ADC_CAP_BUFSZ-1);
+	}
+
+	return len;
+}
+
+/*
+ * DMA half/full boundary while capturing
+ */
+void ADC_CapDMAIRQ(void)
+{
+	uint32_t bound;
+
+	if(__HAL_DMA_GET_FLAG(&hdma_adc1, DMA_FLAG_HTIF0_4) != RESET)
+	{
+		__HAL_DMA_CLEAR_FLAG(&hdma_adc1, DMA_FLAG_HTIF0_4);
+		bound = ADC_CAP_BUFSZ/2;
+	}
+	else if(__HAL_DMA_GET_FLAG(&hdma_adc1, DMA_FLAG_TCIF0_4) != RESET)
+	{
+		__HAL_DMA_CLEAR_FLAG(&hdma_adc1, DMA_FLAG_TCIF0_4);
+		bound = 0;
+	}
+	else
+		return;
+
+	switch(cap_state)
+	{
+		case ADC_CAP_FILL:
+			/* half a ring of history is enough for any pre depth */
+			cap_state = ADC_CAP_ARMED;
+			if(cap_swtrig)
+				ADC_CapLatch();
+			else if(cap_trig == ADC_CAP_TRIG_AWD)
+			{
+				ADC1->SR = ~ADC_SR_AWD;
+				ADC1->CR1 |= ADC_CR1_AWDIE;
+			}
+			break;
+
+		case ADC_CAP_POST:
+			/* count what's landed since the trigger */
+			cap_count += (bound - cap_last) & (ADC_CAP_BUFSZ-1);
+			cap_last = bound;
+			if(cap_count >= cap_post)
+			{
+				ADC_CapHalt();
+				cap_state = ADC_CAP_DONE;
+				if(cap_cb)
+					cap_cb();
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+/*
+ * analog watchdog fired on ADC1
+ */
+void ADC_CapAWDIRQ(void)
+{
+	if(!(ADC1->SR & ADC_SR_AWD))
+		return;
+	ADC1->SR = ~ADC_SR_AWD;
+
+	if(cap_state == ADC_CAP_ARMED)
+		ADC_CapLatch();
+}
@@ -0,0 +1,43 @@
+/*
+ * adc_capture.h - high-speed interleaved single-channel ADC capture
+ */
+
+#ifndef __adc_capture__
+#define __adc_capture__
+
+#include "stm32f4xx_hal.h"
+
+/* capture ring size in samples - max pre+post depth is half of this */
+#define ADC_CAP_BUFSZ 16384
+#define ADC_CAP_MARGIN 64
+#define ADC_CAP_MAXDEPTH (ADC_CAP_BUFSZ/2 - ADC_CAP_MARGIN)
+
+/* trigger sources */
+enum adc_cap_trig
+{
+	ADC_CAP_TRIG_SW,        // ADC_CapTrigger() call
+	ADC_CAP_TRIG_AWD,       // ADC1 analog watchdog outside lo..hi window
+};
+
+/* capture states */
+enum adc_cap_state
+{
+	ADC_CAP_IDLE,
+	ADC_CAP_FILL,           // collecting pre-trigger history
+	ADC_CAP_ARMED,          // waiting for trigger
+	ADC_CAP_POST,           // collecting post-trigger data
+	ADC_CAP_DONE,
+};
+
+uint8_t ADC_CapStart(uint8_t chl, uint8_t smp, uint16_t pre, uint16_t post,
+	uint8_t trig, uint16_t lo, uint16_t hi, void (*cb)(void));
+void ADC_CapTrigger(void);
+void ADC_CapAbort(void);
+uint8_t ADC_CapState(void);
+uint8_t ADC_CapBusy(void);
+uint32_t ADC_CapGetRate(void);
+uint16_t ADC_CapRead(uint16_t *dst, uint16_t len);
+void ADC_CapDMAIRQ(void);
+void ADC_CapAWDIRQ(void);
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * adc_event.c - timestamped ADC threshold events
+ *
+ * Two sources feed one queue, both at the ADC DMA priority so there's
+ * only ever one producer running:
+ *
+ * - the ADC1 analog watchdog guards one input on every raw conversion.
+ *   The flag doesn't say which side tripped and DR has moved on to other
+ *   channels by the time the IRQ runs, so the side comes from the input's
+ *   latest out-of-window sample in the DMA buffer. After it trips the
+ *   window is moved so the next interrupt is the return by the hysteresis
+ *   rather than a storm of repeats.
+ * - software comparators check every raw sample of a scan block, so
+ *   short excursions between filter outputs aren't missed. Timestamps
+ *   are back-dated from the block time by the scan period. They follow
+ *   an ADC input, so its place in the scan is looked up again whenever
+ *   the scan is reconfigured.
+ */
+
+#include "adc_event.h"
+#include "adc.h"
+#include "adc_capture.h"
+#include "idle.h"
+#include "cyclesleep.h"
+
+/* comparator & watchdog states */
+enum evt_state
+{
+	EVT_NORMAL,
+	EVT_OVER,
+	EVT_UNDER,
+};
+
+typedef struct
+{
+	uint8_t chl, idx, dir, state;
+	uint16_t level, hyst;
+} evt_cmp;
+
+/* sequence index of a comparator input that isn't in the scan */
+#define EVT_NOIDX 0xFF
+
+/* queue */
+ADC_Event evt_queue[ADC_EVT_QUEUESZ];
+volatile uint32_t evt_head, evt_tail, evt_dropped;
+
+/* comparators */
+evt_cmp evt_cmps[ADC_EVT_MAXCMP];
+uint8_t evt_numcmp;
+
+/* watchdog */
+uint8_t evt_awd_chl = ADC_EVT_AWD, evt_awd_state;
+uint16_t evt_awd_lo, evt_awd_hi, evt_awd_hyst;
+
+/*
+ * add an event - drops the newest when full
+ */
+static void ADC_EventPut(uint8_t src, uint8_t type, uint16_t value,
+	uint64_t cycles)
+{
+	ADC_Event *e;
+
+	if(evt_head - evt_tail >= ADC_EVT_QUEUESZ)
+	{
+		evt_dropped++;
+		return;
+	}
+
+	e = &evt_queue[evt_head & (ADC_EVT_QUEUESZ-1)];
+	e->cycles = cycles;
+	e->value = value;
+	e->src = src;
+	e->type = type;
+	__DMB();
+	evt_head++;
+	idle_post(IDLE_EV_ADC);
+}
+
+/*
+ * load the watchdog window for the current state
+ */
+static void ADC_EventAWDWindow(void)
+{
+	switch(evt_awd_state)
+	{
+		case EVT_OVER:
+			/* wait to drop below hi - hyst */
+			ADC1->LTR = evt_awd_hi > evt_awd_hyst ?
+				evt_awd_hi - evt_awd_hyst : 0;
+			ADC1->HTR = 4095;
+			break;
+
+		case EVT_UNDER:
+			/* wait to rise above lo + hyst */
+			ADC1->LTR = 0;
+			ADC1->HTR = evt_awd_lo + evt_awd_hyst;
+			break;
+
+		default:
+			ADC1->LTR = evt_awd_lo;
+			ADC1->HTR = evt_awd_hi;
+			break;
+	}
+}
+
+/*
+ * guard ADC input chl (ADC_CHANNEL_x) with a lo..hi window in counts.
+ * chl = ADC_EVT_AWD turns the watchdog off.
+ */
+uint8_t ADC_EventAWD(uint8_t chl, uint16_t lo, uint16_t hi, uint16_t hyst)
+{
+	if((chl != ADC_EVT_AWD) && ((chl > 18) || (lo > hi) || (hi > 4095)))
+		return 1;
+
+	HAL_NVIC_DisableIRQ(ADC_IRQn);
+	evt_awd_chl = chl;
+	evt_awd_lo = lo;
+	evt_awd_hi = hi;
+	evt_awd_hyst = hyst;
+
+	/* capture owns the watchdog - ADC_Start applies this when it's done */
+	if(!ADC_CapBusy())
+		ADC_EventStart();
+	HAL_NVIC_EnableIRQ(ADC_IRQn);
+
+	return 0;
+}
+
+/*
+ * where ADC input chl is in the current scan
+ */
+static uint8_t ADC_EventSeqIdx(uint8_t chl)
+{
+	uint8_t i, num = ADC_GetNumChls();
+
+	for(i=0;i<num;i++)
+		if(ADC_GetChlInput(i) == chl)
+			return i;
+
+	return EVT_NOIDX;
+}
+
+/*
+ * add a comparator on ADC input chl (ADC_CHANNEL_x) - dir is ADC_EVT_OVER
+ * or ADC_EVT_UNDER. It only runs while chl is in the scan. Returns the
+ * comparator number or ADC_EVT_AWD if full.
+ */
+uint8_t ADC_EventAddCmp(uint8_t chl, uint8_t dir, uint16_t level,
+	uint16_t hyst)
+{
+	evt_cmp *c;
+
+	if((evt_numcmp >= ADC_EVT_MAXCMP) || (chl > 18) ||
+		(dir > ADC_EVT_UNDER))
+		return ADC_EVT_AWD;
+
+	c = &evt_cmps[evt_numcmp];
+	c->chl = chl;
+	c->idx = ADC_EventSeqIdx(chl);
+	c->dir = dir;
+	c->level = level;
+	c->hyst = hyst;
+	c->state = EVT_NORMAL;
+
+	/* publish after the entry is complete */
+	__DMB();
+	return evt_numcmp++;
+}
+
+/*
+ * remove all comparators
+ */
+void ADC_EventClearCmp(void)
+{
+	evt_numcmp = 0;
+}
+
+/*
+ * get the oldest event - returns 0 if there are none
+ */
+uint8_t ADC_EventGet(ADC_Event *evt)
+{
+	if(evt_tail == evt_head)
+		return 0;
+
+	*evt = evt_queue[evt_tail & (ADC_EVT_QUEUESZ-1)];
+	__DMB();
+	evt_tail++;
+
+	return 1;
+}
+
+/*
+ * events lost to a full queue
+ */
+uint32_t ADC_EventDropped(void)
+{
+	return evt_dropped;
+}
+
+/*
+ * (re)arm the watchdog & find the comparator inputs in the scan - called
+ * by ADC_Start after ADC1 is set up
+ */
+void ADC_EventStart(void)
+{
+	uint8_t i;
+
+	for(i=0;i<evt_numcmp;i++)
+	{
+		evt_cmps[i].idx = ADC_EventSeqIdx(evt_cmps[i].chl);
+		evt_cmps[i].state = EVT_NORMAL;
+	}
+
+	ADC1->CR1 &= ~(ADC_CR1_AWDIE | ADC_CR1_AWDEN | ADC_CR1_AWDSGL |
+		ADC_CR1_AWDCH);
+	if(evt_awd_chl == ADC_EVT_AWD)
+		return;
+
+	evt_awd_state = EVT_NORMAL;
+	ADC_EventAWDWindow();
+	ADC1->SR = ~ADC_SR_AWD;
+	ADC1->CR1 |= ADC_CR1_AWDEN | ADC_CR1_AWDSGL | evt_awd_chl |
+		ADC_CR1_AWDIE;
+}
+
+/*
+ * run the comparators over one block of num-channel scans
+ */
+void ADC_EventBlock(const uint16_t *blk, uint8_t num, uint64_t cycles,
+	uint32_t scancyc)
+{
+	uint8_t i, j;
+	uint16_t x;
+	const uint16_t *p;
+	evt_cmp *c;
+
+	for(i=0;i<evt_numcmp;i++)
+	{
+		c = &evt_cmps[i];
+		if(c->idx >= num)
+			continue;
+
+		p = &blk[c->idx];
+		for(j=0;j<ADC_BLOCKSZ;j++,p+=num)
+		{
+			x = *p;
+			if(c->state == EVT_NORMAL)
+			{
+				if((c->dir == ADC_EVT_OVER) ? (x > c->level) :
+					(x < c->level))
+				{
+					c->state = EVT_OVER + c->dir;
+					ADC_EventPut(i, c->dir, x,
+						cycles - (ADC_BLOCKSZ-1-j)*scancyc);
+				}
+			}
+			else if((c->dir == ADC_EVT_OVER) ? (x + c->hyst < c->level) :
+				(x > c->level + c->hyst))
+			{
+				c->state = EVT_NORMAL;
+				ADC_EventPut(i, ADC_EVT_CLEAR, x,
+					cycles - (ADC_BLOCKSZ-1-j)*scancyc);
+			}
+		}
+	}
+}
+
+/*
+ * ADC1 analog watchdog interrupt
+ */
+void ADC_EventAWDIRQ(void)
+{
+	uint64_t cycles = cyccnt64();
+	uint16_t x, last;
+	uint8_t n;
+
+	if(!(ADC1->SR & ADC_SR_AWD))
+		return;
+	ADC1->SR = ~ADC_SR_AWD;
+
+	if(evt_awd_state != EVT_NORMAL)
+	{
+		/* back inside */
+		ADC_EventPut(ADC_EVT_AWD, ADC_EVT_CLEAR, evt_awd_state == EVT_OVER ?
+			evt_awd_hi : evt_awd_lo, cycles);
+		evt_awd_state = EVT_NORMAL;
+	}
+	else
+	{
+		/*
+		 * newest sample outside the window says which side - if it's
+		 * already been overwritten use the nearer limit to the latest
+		 */
+		last = x = ADC_GetRawRecent(evt_awd_chl, 0);
+		for(n=1;(x != ADC_RAW_NONE) && (x >= evt_awd_lo) &&
+			(x <= evt_awd_hi);n++)
+			x = ADC_GetRawRecent(evt_awd_chl, n);
+		if(x == ADC_RAW_NONE)
+			x = last;
+		if((x > evt_awd_hi) ||
+			((x >= evt_awd_lo) && (x > (evt_awd_lo + evt_awd_hi)/2)))
+		{
+			evt_awd_state = EVT_OVER;
+			ADC_EventPut(ADC_EVT_AWD, ADC_EVT_OVER, evt_awd_hi, cycles);
+		}
+		else
+		{
+			evt_awd_state = EVT_UNDER;
+			ADC_EventPut(ADC_EVT_AWD, ADC_EVT_UNDER, evt_awd_lo, cycles);
+		}
+	}
+
+	ADC_EventAWDWindow();
+}
@@ -0,0 +1,46 @@
+/*
+ * adc_event.h - timestamped ADC threshold events
+ */
+
+#ifndef __adc_event__
+#define __adc_event__
+
+#include "stm32f4xx_hal.h"
+
+/* queue depth - must be a power of 2 */
+#define ADC_EVT_QUEUESZ 32
+
+/* software comparators */
+#define ADC_EVT_MAXCMP 8
+
+/* event source for the hardware watchdog, comparators are 0 and up */
+#define ADC_EVT_AWD 0xFF
+
+/* event types - also comparator directions */
+enum adc_evt_type
+{
+	ADC_EVT_OVER,           // rose above the high threshold
+	ADC_EVT_UNDER,          // fell below the low threshold
+	ADC_EVT_CLEAR,          // back inside by the hysteresis
+};
+
+typedef struct
+{
+	uint64_t cycles;        /* cyccnt64() of the sample */
+	uint16_t value;         /* sample, or the crossed limit for the AWD */
+	uint8_t src;            /* comparator number or ADC_EVT_AWD */
+	uint8_t type;           /* enum adc_evt_type */
+} ADC_Event;
+
+uint8_t ADC_EventAWD(uint8_t chl, uint16_t lo, uint16_t hi, uint16_t hyst);
+uint8_t ADC_EventAddCmp(uint8_t chl, uint8_t dir, uint16_t level,
+	uint16_t hyst);
+void ADC_EventClearCmp(void);
+uint8_t ADC_EventGet(ADC_Event *evt);
+uint32_t ADC_EventDropped(void);
+void ADC_EventStart(void);
+void ADC_EventBlock(const uint16_t *blk, uint8_t num, uint64_t cycles,
+	uint32_t scancyc);
+void ADC_EventAWDIRQ(void);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * blog.c - deferred-format binary logging
+ *
+ * A record is the little-endian 16-bit format ID, the cycles since the
+ * last record sent as an LEB128 varint, then each arg as a zigzag varint,
+ * followed by a CRC-16/CCITT. It's COBS encoded and sent between two zero
+ * bytes so the host can resync after drops or plain text on the same
+ * USART. Records dropped here don't move the delta base, but one lost on
+ * the wire shifts the host's times after it by its delta.
+ */
+
+#include <string.h>
+#include "blog.h"
+#include "usart.h"
+#include "printf.h"
+#include "cyclesleep.h"
+#include "irqstat.h"
+
+uint32_t blog_drops;
+uint64_t blog_last;
+
+/* CRC-16/CCITT a nibble at a time - small table, no loop per bit */
+static const uint16_t blog_crctab[16] =
+{
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+static uint16_t blog_crc(const uint8_t *buf, uint8_t len)
+{
+	uint16_t crc = 0xFFFF;
+
+	while(len--)
+	{
+		crc = (crc << 4) ^ blog_crctab[(crc >> 12) ^ (*buf >> 4)];
+		crc = (crc << 4) ^ blog_crctab[(crc >> 12) ^ (*buf++ & 15)];
+	}
+
+	return crc;
+}
+
+/*
+ * 7 bits per byte, low first, top bit set on all but the last
+ */
+static uint8_t *blog_varint(uint8_t *p, uint32_t v)
+{
+	while(v >= 0x80)
+	{
+		*p++ = v | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+
+	return p;
+}
+
+static uint8_t *blog_varint64(uint8_t *p, uint64_t v)
+{
+	/* the low word carries it once the rest fits */
+	while(v >> 32)
+	{
+		*p++ = v | 0x80;
+		v >>= 7;
+	}
+
+	return blog_varint(p, v);
+}
+
+/*
+ * build a complete frame for a record dt cycles after the last one
+ * returns its length
+ */
+uint8_t blog_encode(uint8_t *frame, uint32_t id, uint64_t dt, uint8_t nargs,
+	const uint32_t *args)
+{
+	uint8_t raw[BLOG_RAWSZ], len, i, *code, *dst;
+	uint16_t crc;
+
+	raw[0] = id;
+	raw[1] = id >> 8;
+	dst = blog_varint64(&raw[2], dt);
+
+	/* zigzag keeps small negative values short too */
+	for(i=0;i<nargs;i++)
+		dst = blog_varint(dst,
+			(args[i] << 1) ^ (uint32_t)((int32_t)args[i] >> 31));
+
+	len = dst - raw;
+	crc = blog_crc(raw, len);
+	raw[len++] = crc;
+	raw[len++] = crc >> 8;
+
+	/* COBS - each code byte counts up to the next zero */
+	frame[0] = 0;
+	code = &frame[1];
+	dst = code + 1;
+	for(i=0;i<len;i++)
+	{
+		if(raw[i])
+			*dst++ = raw[i];
+		else
+		{
+			*code = dst - code;
+			code = dst++;
+		}
+	}
+	*code = dst - code;
+	*dst++ = 0;
+
+	return dst - frame;
+}
+
+/*
+ * send a frame whole or not at all - a partial one would also take out
+ * the next record on the host. The delta has to be taken & sent in the
+ * same order, so the encode is done under the lock too.
+ */
+void blog_send(uint32_t id, uint8_t nargs, const uint32_t *args)
+{
+	uint8_t frame[BLOG_FRAMESZ], len;
+	uint32_t prim;
+	uint64_t now;
+
+	IRQ_LOCK(prim);
+	now = cyccnt64();
+	len = blog_encode(frame, id, now - blog_last, nargs, args);
+	if(usart_tx_free() >= len)
+	{
+		usart_write(frame, len);
+		blog_last = now;
+	}
+	else
+		blog_drops++;
+	IRQ_UNLOCK(prim);
+}
+
+/*
+ * records lost to a full USART ring
+ */
+uint32_t blog_dropped(void)
+{
+	return blog_drops;
+}
+
+/*
+ * compare against formatting the same record as text
+ */
+void blog_benchmark(void)
+{
+	const uint32_t args[3] = {3, 1, 1234};
+	uint8_t frame[BLOG_FRAMESZ], flen;
+	char txt[64];
+	uint32_t bact, pact, tot, plen;
+
+	/* a record 1ms after the last */
+	start_meas();
+	flen = blog_encode(frame, 0x123, 168000, 3, args);
+	end_meas();
+	get_meas(&bact, &tot);
+
+	start_meas();
+	snprintf(txt, sizeof(txt), "evt %d type %d val %d @ %u\n\r", args[0],
+		args[1], args[2], DWT->CYCCNT);
+	end_meas();
+	get_meas(&pact, &tot);
+	plen = strlen(txt);
+
+	printf("blog %d cyc %d bytes, printf %d cyc %d bytes - %d.%dx on the wire\n\r",
+		bact, flen, pact, plen, plen / flen, (10 * plen / flen) % 10);
+}
@@ -0,0 +1,45 @@
+/*
+ * blog.h - deferred-format binary logging
+ *
+ * BLOG("fmt", args...) sends the format string's ID, the cyccnt64() time
+ * since the previous record and up to BLOG_MAXARGS 32-bit args, all as
+ * varints so small values take a byte or two. tools/blogdec.c sums
+ * the deltas back into a timeline. The format strings are kept in the
+ * non-loaded .blog ELF section and only expanded on the host, so args
+ * must be integers (%d %u %x %X %c). IDs are 16 bits so the section must
+ * stay under 64kB.
+ */
+
+#ifndef __blog__
+#define __blog__
+
+#include "stm32f4xx_hal.h"
+
+/* args per record */
+#define BLOG_MAXARGS 6
+
+/* worst-case frame: id, varint delta & args, CRC, COBS code & delimiters */
+#define BLOG_RAWSZ (2+10+5*BLOG_MAXARGS+2)
+#define BLOG_FRAMESZ (BLOG_RAWSZ+3)
+
+/* count 0..6 macro args */
+#define BLOG_NARGS(...) BLOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define BLOG_NARGS_(z, a, b, c, d, e, f, n, ...) n
+
+/* log one record - safe from IRQs, drops the record if the USART is full */
+#define BLOG(fmt, ...) do { \
+	static const char blog_fmt_[] \
+		__attribute__((section(".blog"), used)) = fmt; \
+	const uint32_t blog_args_[] = {0, ##__VA_ARGS__}; \
+	_Static_assert(sizeof(blog_args_) <= 4*(BLOG_MAXARGS+1), \
+		"too many BLOG args"); \
+	blog_send((uint32_t)blog_fmt_, BLOG_NARGS(__VA_ARGS__), &blog_args_[1]); \
+	} while(0)
+
+uint8_t blog_encode(uint8_t *frame, uint32_t id, uint64_t dt, uint8_t nargs,
+	const uint32_t *args);
+void blog_send(uint32_t id, uint8_t nargs, const uint32_t *args);
+uint32_t blog_dropped(void);
+void blog_benchmark(void);
+
+#endif
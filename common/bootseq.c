@@ -0,0 +1,150 @@
+/*
+ * bootseq.c - dependency-ordered asynchronous init sequencer
+ *
+ * Each step is a protothread that starts once all the steps in its
+ * dependency mask have ended, so the delays of independent steps
+ * overlap and boot takes as long as the longest chain. When every
+ * running step is in a delay the core sleeps until the first is due.
+ * A step that exits fails, and so does everything depending on it.
+ */
+
+#include "bootseq.h"
+#include "printf.h"
+
+#define BOOT_BARW 40
+
+/* step states after the run */
+#define BOOT_SKIPPED 0xFF
+
+boot_step boot_steps[BOOT_MAXSTEPS];
+uint8_t boot_num;
+uint32_t boot_t0, boot_total;
+
+/*
+ * add a step - returns its id for BOOT_DEP() or -1 if the table is full
+ */
+int8_t boot_add(const char *name, boot_fn fn, uint32_t deps)
+{
+	boot_step *s;
+
+	if(boot_num >= BOOT_MAXSTEPS)
+		return -1;
+
+	s = &boot_steps[boot_num];
+	s->name = name;
+	s->fn = fn;
+	s->deps = deps;
+	s->started = 0;
+	s->active = 0;
+
+	return boot_num++;
+}
+
+/*
+ * run every step to its end - returns the mask of failed or skipped ones
+ */
+uint32_t boot_run(void)
+{
+	boot_step *s;
+	uint32_t all = (1UL << boot_num) - 1, done = 0, failed = 0, bit;
+	uint32_t goal = 0, t;
+	uint8_t i, r, ran, sleeping;
+
+	boot_t0 = DWT->CYCCNT;
+	while((done | failed) != all)
+	{
+		ran = sleeping = 0;
+		for(i=0;i<boot_num;i++)
+		{
+			s = &boot_steps[i];
+			bit = 1UL << i;
+			if((done | failed) & bit)
+				continue;
+
+			/* a failed dependency means this can't run either */
+			if(s->deps & failed)
+			{
+				s->pt.state = BOOT_SKIPPED;
+				s->start = s->end = DWT->CYCCNT;
+				failed |= bit;
+				ran = 1;
+				continue;
+			}
+			if((s->deps & done) != s->deps)
+				continue;
+
+			if(!s->started)
+			{
+				s->started = 1;
+				s->start = DWT->CYCCNT;
+				PT_INIT(&s->pt);
+			}
+			t = DWT->CYCCNT;
+			r = s->fn(&s->pt);
+			s->end = DWT->CYCCNT;
+			s->active += s->end - t;
+
+			if(r >= PT_EXITED)
+			{
+				s->pt.state = r;
+				if(r == PT_ENDED)
+					done |= bit;
+				else
+					failed |= bit;
+				ran = 1;
+			}
+			else if(r == PT_SLEEPING)
+			{
+				if(!sleeping || ((int32_t)(s->pt.goal - goal) < 0))
+					goal = s->pt.goal;
+				sleeping = 1;
+			}
+			else
+				ran = 1;
+		}
+
+		if(sleeping && !ran)
+			idle_sleep_until(goal, 0);
+		else if(!sleeping && !ran)
+		{
+			/* nothing can start - a dependency loop or a bad mask */
+			for(i=0;i<boot_num;i++)
+				if(!((done | failed) & (1UL << i)))
+				{
+					boot_steps[i].pt.state = BOOT_SKIPPED;
+					boot_steps[i].start = boot_steps[i].end = DWT->CYCCNT;
+				}
+			failed = all & ~done;
+		}
+	}
+	boot_total = DWT->CYCCNT - boot_t0;
+
+	return failed;
+}
+
+/*
+ * timeline in us from the start of boot_run, with a bar for each step
+ */
+void boot_report(void)
+{
+	boot_step *s;
+	uint32_t cpu = SystemCoreClock / 1000000, tot = boot_total | 1;
+	uint32_t a, b;
+	uint8_t i;
+	char bar[BOOT_BARW+1];
+
+	printf("step        start      end   active\n\r");
+	for(s=boot_steps;s<&boot_steps[boot_num];s++)
+	{
+		a = (uint64_t)(s->start - boot_t0) * BOOT_BARW / tot;
+		b = (uint64_t)(s->end - boot_t0) * BOOT_BARW / tot;
+		for(i=0;i<BOOT_BARW;i++)
+			bar[i] = (i >= a) && (i <= b) ? '#' : '.';
+		bar[BOOT_BARW] = 0;
+		printf("%-8s %8u %8u %8u %s %s\n\r", s->name,
+			(s->start - boot_t0) / cpu, (s->end - boot_t0) / cpu,
+			s->active / cpu, bar, s->pt.state == PT_ENDED ? "ok" :
+			s->pt.state == PT_EXITED ? "failed" : "skipped");
+	}
+	printf("boot %u us\n\r", boot_total / cpu);
+}
@@ -0,0 +1,35 @@
+/*
+ * bootseq.h - dependency-ordered asynchronous init sequencer
+ */
+
+#ifndef __bootseq__
+#define __bootseq__
+
+#include "stm32f4xx_hal.h"
+#include "pt.h"
+
+#define BOOT_MAXSTEPS 16
+
+/* dependency mask for a step id */
+#define BOOT_DEP(id) (1UL << (id))
+
+/* a step is a protothread - a plain function returning PT_ENDED will do */
+typedef uint8_t (*boot_fn)(pt_ctx *pt);
+
+typedef struct
+{
+	const char *name;
+	boot_fn fn;
+	uint32_t deps;
+	pt_ctx pt;
+	uint8_t started;
+	uint32_t start;
+	uint32_t end;
+	uint32_t active;
+} boot_step;
+
+int8_t boot_add(const char *name, boot_fn fn, uint32_t deps);
+uint32_t boot_run(void);
+void boot_report(void);
+
+#endif
@@ -6,10 +6,14 @@
  */
 
 #include "cyclesleep.h"
+#include "idle.h"
 
 uint32_t DelayCyc1s;
 uint32_t s_tot, act_cyc, tot_cyc;
 
+/* wraps << 1 | top bit of CYCCNT at the last tick - one word so it's atomic */
+volatile uint32_t cyc64_state;
+
 /*
  * turn on cycle counter
  */
@@ -31,6 +35,9 @@ void cyccnt_enable()
 
 	/* get sysclk freq for computing delay */
 	DelayCyc1s = HAL_RCC_GetSysClockFreq();
+
+	/* 64-bit time starts from here */
+	cyc64_state = DWT->CYCCNT >> 31;
 }
 
 /*
@@ -62,6 +69,72 @@ uint32_t cyclecheck(uint32_t goal)
 	return (((int32_t)DWT->CYCCNT - (int32_t)goal) < 0);
 }
 
+/*
+ * wrap tracking - the only writer, called from SysTick
+ */
+void cyccnt64_tick(void)
+{
+	uint32_t s = cyc64_state, msb = DWT->CYCCNT >> 31;
+
+	/* top bit went from 1 to 0 - the counter wrapped */
+	if((s & 1) && !msb)
+		s += 2;
+	cyc64_state = (s & ~1) | msb;
+}
+
+/*
+ * 64-bit cycle count - lock-free so it's good from any IRQ. If the top
+ * bit was set at the last tick and isn't now, the wrap hasn't been
+ * counted yet.
+ */
+uint64_t cyccnt64(void)
+{
+	uint32_t s = cyc64_state;
+	uint32_t now = DWT->CYCCNT;
+	uint32_t hi = s >> 1;
+
+	if((s & 1) && !(now >> 31))
+		hi++;
+
+	return ((uint64_t)hi << 32) | now;
+}
+
+/*
+ * 64-bit goals never wrap so they can be any distance away
+ */
+uint64_t cyclegoal64(uint64_t cycles)
+{
+	return cycles + cyccnt64();
+}
+
+uint64_t cyclegoal64_ms(uint32_t ms)
+{
+	return (uint64_t)ms*(DelayCyc1s/1000) + cyccnt64();
+}
+
+/*
+ * return TRUE if goal is not yet reached, like cyclecheck()
+ */
+uint32_t cyclecheck64(uint64_t goal)
+{
+	return cyccnt64() < goal;
+}
+
+/*
+ * cycles to time
+ */
+uint64_t cyc_to_us(uint64_t cycles)
+{
+	return cycles / (DelayCyc1s/1000000);
+}
+
+uint64_t cyc_to_ns(uint64_t cycles)
+{
+	uint32_t mhz = DelayCyc1s/1000000;
+
+	return (cycles / mhz) * 1000 + (cycles % mhz) * 1000 / mhz;
+}
+
 /*
  * sleep for a certain number of cycles
  */
@@ -73,11 +146,18 @@ void cyclesleep(uint32_t cycles)
 }
 
 /*
- * sleep for a certain number of milliseconds
+ * sleep for a certain number of milliseconds - in WFI once idle is up.
+ * 32-bit goals only reach 12s so long waits go in pieces.
  */
 void delay(uint32_t ms)
 {
-	cyclesleep(ms*(DelayCyc1s/1000));
+	uint64_t goal = cyclegoal64_ms(ms), rem;
+
+	while(cyclecheck64(goal))
+	{
+		rem = goal - cyccnt64();
+		idle_sleep_for(rem < 0x40000000 ? rem : 0x40000000, 0);
+	}
 }
 
 /*
@@ -3,6 +3,9 @@
  * 09-05-15 E. Brombaugh - updated for F7 and HAL
  * 03-20-17 E. Brombaugh - fixed wrap bug, update comments
  * 10-21-20 E. Brombaugh - updated for F4
+ *
+ * cyccnt64() is the common 64-bit timebase - the low word is DWT->CYCCNT
+ * and cyccnt64_tick() must run at least every 12s to catch the wraps.
  */
 
 #ifndef __cyclesleep__
@@ -15,6 +18,13 @@ void cyclesleep(uint32_t cycles);
 uint32_t cyclegoal(uint32_t cycles);
 uint32_t cyclegoal_ms(uint32_t ms);
 uint32_t cyclecheck(uint32_t goal);
+void cyccnt64_tick(void);
+uint64_t cyccnt64(void);
+uint64_t cyclegoal64(uint64_t cycles);
+uint64_t cyclegoal64_ms(uint32_t ms);
+uint32_t cyclecheck64(uint64_t goal);
+uint64_t cyc_to_us(uint64_t cycles);
+uint64_t cyc_to_ns(uint64_t cycles);
 void delay(uint32_t ms);
 void start_meas(void);
 void end_meas(void);
@@ -0,0 +1,169 @@
+/*
+ * decimate.c - CIC + compensating FIR decimation filter for ADC channels
+ */
+
+#include "decimate.h"
+
+/*
+ * 3-tap compensators [-b, 1+2b, -b] in Q30. The droop of an order N CIC
+ * is approximately 1 - N*w^2/24 at the output rate so b = N/24.
+ */
+const int32_t decim_comp3[DECIM_MAXORDER][3] =
+{
+	{ -44739243, 1163220309,  -44739243},	// N = 1
+	{ -89478485, 1252698795,  -89478485},	// N = 2
+	{-134217728, 1342177280, -134217728},	// N = 3
+	{-178956971, 1431655765, -178956971},	// N = 4
+};
+
+/*
+ * 32x32+64 signed multiply-accumulate - not provided by cmsis_gcc.h
+ */
+__STATIC_FORCEINLINE int64_t __SMLAL(int32_t op1, int32_t op2, int64_t acc)
+{
+	union { uint32_t w32[2]; int64_t w64; } llr;
+	llr.w64 = acc;
+
+	__ASM volatile ("smlal %0, %1, %2, %3" : "+r" (llr.w32[0]),
+		"+r" (llr.w32[1]) : "r" (op1), "r" (op2));
+
+	return llr.w64;
+}
+
+/*
+ * set up a channel filter - returns nonzero if the params are invalid
+ */
+uint8_t decim_init(decim_state *s, uint8_t order, uint8_t log2r,
+	const int32_t *coeffs, uint8_t ntaps, uint8_t fir_decim)
+{
+	uint8_t i;
+
+	/* CIC output must fit in 31 bits and the ratio in the phase count */
+	if((order < 1) || (order > DECIM_MAXORDER) || (log2r > DECIM_MAXLOG2R) ||
+		(DECIM_INBITS + order*log2r > 31))
+		return 1;
+
+	/* FIR is optional */
+	if((ntaps > DECIM_MAXTAPS) || (ntaps && !coeffs) ||
+		(fir_decim < 1) || (fir_decim > 2))
+		return 1;
+
+	s->order = order;
+	s->log2r = log2r;
+	s->shift = 31 - DECIM_INBITS - order*log2r;
+	s->ntaps = ntaps;
+	s->fir_decim = fir_decim;
+	s->fir_phase = 0;
+	s->fir_ptr = 0;
+	s->cic_phase = 0;
+	s->coeffs = coeffs;
+	s->out = 0;
+	for(i=0;i<DECIM_MAXORDER;i++)
+	{
+		s->integ[i] = 0;
+		s->comb[i] = 0;
+	}
+	for(i=0;i<2*DECIM_MAXTAPS;i++)
+		s->dly[i] = 0;
+
+	return 0;
+}
+
+/*
+ * FIR stage - push one Q31 sample, returns 1 if an output was computed
+ */
+static uint8_t decim_fir(decim_state *s, int32_t x)
+{
+	int64_t acc = 0;
+	int32_t *d;
+	uint8_t i;
+
+	/* bypass */
+	if(s->ntaps == 0)
+	{
+		s->out = x;
+		return 1;
+	}
+
+	/* newest sample first, mirrored so the taps are contiguous */
+	s->fir_ptr = (s->fir_ptr == 0) ? s->ntaps-1 : s->fir_ptr-1;
+	s->dly[s->fir_ptr] = x;
+	s->dly[s->fir_ptr + s->ntaps] = x;
+
+	/* only compute the outputs we keep */
+	if(++s->fir_phase < s->fir_decim)
+		return 0;
+	s->fir_phase = 0;
+
+	d = &s->dly[s->fir_ptr];
+	for(i=0;i<s->ntaps;i++)
+		acc = __SMLAL(d[i], s->coeffs[i], acc);
+
+	/* Q31 * Q30 -> Q31 with saturation */
+	acc >>= 30;
+	if(acc > INT32_MAX)
+		acc = INT32_MAX;
+	else if(acc < INT32_MIN)
+		acc = INT32_MIN;
+	s->out = acc;
+
+	return 1;
+}
+
+/*
+ * run a block of n samples spaced by stride through the filter
+ * returns the number of new outputs - latest is in s->out
+ */
+uint16_t decim_block(decim_state *s, const uint16_t *in, uint16_t stride,
+	uint16_t n)
+{
+	uint16_t result = 0, r = 1<<s->log2r;
+	uint32_t x, y;
+	uint8_t k;
+
+	while(n--)
+	{
+		/* integrators - modulo arithmetic makes wrap harmless */
+		x = *in;
+		in += stride;
+		for(k=0;k<s->order;k++)
+		{
+			s->integ[k] += x;
+			x = s->integ[k];
+		}
+
+		/* decimate */
+		if(++s->cic_phase < r)
+			continue;
+		s->cic_phase = 0;
+
+		/* combs */
+		for(k=0;k<s->order;k++)
+		{
+			y = x - s->comb[k];
+			s->comb[k] = x;
+			x = y;
+		}
+
+		/* normalize bit growth to Q31 and compensate */
+		result += decim_fir(s, (int32_t)(x << s->shift));
+	}
+
+	return result;
+}
+
+/*
+ * overall decimation ratio
+ */
+uint32_t decim_ratio(decim_state *s)
+{
+	return (1<<s->log2r) * s->fir_decim;
+}
+
+/*
+ * effective output width in bits
+ */
+uint8_t decim_bits(decim_state *s)
+{
+	return DECIM_INBITS + s->order*s->log2r;
+}
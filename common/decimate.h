@@ -0,0 +1,53 @@
+/*
+ * decimate.h - CIC + compensating FIR decimation filter for ADC channels
+ */
+
+#ifndef __decimate__
+#define __decimate__
+
+#include "stm32f4xx_hal.h"
+
+/* input sample width in bits */
+#define DECIM_INBITS 12
+
+/* limits */
+#define DECIM_MAXORDER 4
+#define DECIM_MAXTAPS 16
+
+/* CIC phase counter is 16 bits */
+#define DECIM_MAXLOG2R 15
+
+/*
+ * Per-channel filter state. Output is Q31 with ADC full scale (4096 counts)
+ * at 1.0, so the 12-bit value is out>>19 and any extra bits gained by the
+ * CIC show up below that. FIR coefficients are Q30 to allow passband gain
+ * up to 2 for droop compensation.
+ */
+typedef struct
+{
+	uint8_t order;                  /* CIC stages */
+	uint8_t log2r;                  /* CIC decimation = 1<<log2r */
+	uint8_t shift;                  /* CIC output to Q31 left shift */
+	uint8_t ntaps;                  /* FIR taps, 0 = bypass */
+	uint8_t fir_decim;              /* FIR decimation, 1 or 2 */
+	uint8_t fir_phase;
+	uint8_t fir_ptr;
+	uint16_t cic_phase;
+	uint32_t integ[DECIM_MAXORDER];
+	uint32_t comb[DECIM_MAXORDER];
+	const int32_t *coeffs;
+	int32_t dly[2*DECIM_MAXTAPS];   /* doubled so taps are contiguous */
+	int32_t out;                    /* latest output, Q31 */
+} decim_state;
+
+/* default 3-tap droop compensators for CIC order 1-4 */
+extern const int32_t decim_comp3[DECIM_MAXORDER][3];
+
+uint8_t decim_init(decim_state *s, uint8_t order, uint8_t log2r,
+	const int32_t *coeffs, uint8_t ntaps, uint8_t fir_decim);
+uint16_t decim_block(decim_state *s, const uint16_t *in, uint16_t stride,
+	uint16_t n);
+uint32_t decim_ratio(decim_state *s);
+uint8_t decim_bits(decim_state *s);
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * goertzel.c - fixed-point Goertzel tone detector bank on the ADC stream
+ *
+ * Each detector follows one scan sequence index at the raw scan rate and
+ * runs the Goertzel recursion incrementally over every DMA block, so the
+ * cost is a few cycles per sample with no buffering. Every n samples it
+ * turns the state into a tone amplitude in counts and compares it with
+ * the threshold. The DC level measured over the previous n samples is
+ * removed on the way in so it doesn't leak into low frequency bins.
+ *
+ * The coefficient 2cos(w) is Q30 and the state is 32 bits. An on-bin
+ * tone grows the state by n*A/(2sin(w)) so a full scale tone over the
+ * maximum n fits for frequencies above about fs/1600.
+ */
+
+#include "goertzel.h"
+#include "adc.h"
+#include "cyclesleep.h"
+#include "printf.h"
+#include "arm_math.h"
+
+typedef struct
+{
+	uint8_t idx;            /* scan sequence index */
+	uint16_t n;             /* samples per detection */
+	uint16_t cnt;           /* samples so far */
+	uint16_t thresh;        /* detection amplitude in counts */
+	int32_t coeff;          /* 2cos(w) in Q30 */
+	int32_t s1, s2;         /* recursion state */
+	int32_t dc;             /* offset removed from the input */
+	int32_t sum;            /* input sum for the next offset */
+	float32_t scale;        /* power to amplitude squared */
+	volatile uint16_t mag;  /* latest amplitude in counts */
+	volatile uint8_t det;   /* latest mag >= thresh */
+	volatile uint32_t seq;  /* completed detections */
+} goertzel_state;
+
+goertzel_state goertzel_bank[GOERTZEL_MAX];
+uint8_t goertzel_num;
+
+/*
+ * add a detector for freq Hz on scan index idx over n samples at the
+ * current scan rate - returns its number or GOERTZEL_NONE
+ */
+uint8_t goertzel_add(uint8_t idx, uint32_t freq, uint16_t n, uint16_t thresh)
+{
+	goertzel_state *g;
+	uint32_t rate = ADC_GetRate();
+
+	if((goertzel_num >= GOERTZEL_MAX) || (idx >= ADC_MAXCHLS) ||
+		(n < GOERTZEL_MINN) || (n > GOERTZEL_MAXN) || (2*freq >= rate))
+		return GOERTZEL_NONE;
+
+	g = &goertzel_bank[goertzel_num];
+	g->idx = idx;
+	g->n = n;
+	g->cnt = 0;
+	g->thresh = thresh;
+	g->coeff = (int32_t)(2.0F * cosf(6.2831853F * (float32_t)freq /
+		(float32_t)rate) * 1073741824.0F);
+	g->s1 = g->s2 = 0;
+	g->dc = 2048;
+	g->sum = 0;
+	g->scale = 4.0F / ((float32_t)n * (float32_t)n);
+	g->mag = 0;
+	g->det = 0;
+	g->seq = 0;
+
+	/* publish after the entry is complete */
+	__DMB();
+	return goertzel_num++;
+}
+
+/*
+ * remove all detectors
+ */
+void goertzel_clear(void)
+{
+	goertzel_num = 0;
+}
+
+/*
+ * finish one detection - amplitude from the recursion state
+ */
+static void goertzel_finish(goertzel_state *g)
+{
+	float32_t s1 = (float32_t)g->s1, s2 = (float32_t)g->s2, p;
+
+	p = s1*s1 + s2*s2 - s1*s2*(float32_t)g->coeff*(1.0F/1073741824.0F);
+	if(p < 0.0F)
+		p = 0.0F;
+	g->mag = (uint16_t)sqrtf(p * g->scale);
+	g->det = g->mag >= g->thresh;
+	g->seq++;
+
+	g->dc = g->sum / g->n;
+	g->sum = 0;
+	g->s1 = g->s2 = 0;
+	g->cnt = 0;
+}
+
+/*
+ * run every detector over a block of len scans of num channels
+ */
+void goertzel_block(const uint16_t *blk, uint8_t num, uint16_t len)
+{
+	goertzel_state *g;
+	const uint16_t *p;
+	int32_t s0, s1, s2, x, coeff, dc, sum;
+	uint16_t j, cnt;
+	uint8_t i;
+
+	for(i=0;i<goertzel_num;i++)
+	{
+		g = &goertzel_bank[i];
+		if(g->idx >= num)
+			continue;
+
+		/* keep the state in registers for the inner loop */
+		p = &blk[g->idx];
+		s1 = g->s1;
+		s2 = g->s2;
+		coeff = g->coeff;
+		dc = g->dc;
+		sum = g->sum;
+		cnt = g->cnt;
+		for(j=0;j<len;j++,p+=num)
+		{
+			x = *p;
+			sum += x;
+			s0 = x - dc + (int32_t)(((int64_t)coeff * s1) >> 30) - s2;
+			s2 = s1;
+			s1 = s0;
+			if(++cnt == g->n)
+			{
+				g->s1 = s1;
+				g->s2 = s2;
+				g->sum = sum;
+				goertzel_finish(g);
+				s1 = s2 = sum = 0;
+				dc = g->dc;
+				cnt = 0;
+			}
+		}
+		g->s1 = s1;
+		g->s2 = s2;
+		g->sum = sum;
+		g->cnt = cnt;
+	}
+}
+
+/*
+ * latest tone amplitude in counts
+ */
+uint16_t goertzel_get_mag(uint8_t det)
+{
+	if(det >= goertzel_num)
+		return 0;
+
+	return goertzel_bank[det].mag;
+}
+
+/*
+ * nonzero if the latest detection was over threshold
+ */
+uint8_t goertzel_get_det(uint8_t det)
+{
+	if(det >= goertzel_num)
+		return 0;
+
+	return goertzel_bank[det].det;
+}
+
+/*
+ * completed detections - changes when mag & det are updated
+ */
+uint32_t goertzel_get_seq(uint8_t det)
+{
+	if(det >= goertzel_num)
+		return 0;
+
+	return goertzel_bank[det].seq;
+}
+
+/*
+ * cycle budget - cost per sample for 1 to GOERTZEL_MAX detectors on a
+ * block of 5-channel scans, against the cycles per scan available at
+ * the current rate
+ */
+void goertzel_benchmark(void)
+{
+	static uint16_t blk[ADC_BLOCKSZ*5];
+	goertzel_state save[GOERTZEL_MAX];
+	uint8_t save_num = goertzel_num, i, d;
+	uint32_t act, tot, budget = SystemCoreClock / ADC_GetRate();
+	uint16_t j;
+
+	for(j=0;j<ADC_BLOCKSZ*5;j++)
+		blk[j] = 2048 + (j & 255);
+
+	/* run from the caller so the bank is ours while we measure */
+	HAL_NVIC_DisableIRQ(DMA2_Stream0_IRQn);
+	for(i=0;i<GOERTZEL_MAX;i++)
+		save[i] = goertzel_bank[i];
+
+	printf("goertzel budget %d cycles/scan\n\r", budget);
+	printf(" dets  cyc/blk  cyc/smp/det  %%budget\n\r");
+	goertzel_num = 0;
+	for(d=1;d<=GOERTZEL_MAX;d++)
+	{
+		goertzel_add(d % 5, 60, 1024, 100);
+		start_meas();
+		goertzel_block(blk, 5, ADC_BLOCKSZ);
+		end_meas();
+		get_meas(&act, &tot);
+		printf(" %4d  %7d  %11d  %7d\n\r", d, act,
+			act / (ADC_BLOCKSZ*d), 100 * act / (ADC_BLOCKSZ*budget));
+	}
+
+	for(i=0;i<GOERTZEL_MAX;i++)
+		goertzel_bank[i] = save[i];
+	goertzel_num = save_num;
+	HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+}
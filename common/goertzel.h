@@ -0,0 +1,26 @@
+/*
+ * goertzel.h - fixed-point Goertzel tone detector bank on the ADC stream
+ */
+
+#ifndef __goertzel__
+#define __goertzel__
+
+#include "stm32f4xx_hal.h"
+
+/* detectors in the bank */
+#define GOERTZEL_MAX 8
+#define GOERTZEL_NONE 0xFF
+
+/* detection block length limits in samples */
+#define GOERTZEL_MINN 16
+#define GOERTZEL_MAXN 8192
+
+uint8_t goertzel_add(uint8_t idx, uint32_t freq, uint16_t n, uint16_t thresh);
+void goertzel_clear(void);
+void goertzel_block(const uint16_t *blk, uint8_t num, uint16_t len);
+uint16_t goertzel_get_mag(uint8_t det);
+uint8_t goertzel_get_det(uint8_t det);
+uint32_t goertzel_get_seq(uint8_t det);
+void goertzel_benchmark(void);
+
+#endif
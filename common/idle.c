@@ -0,0 +1,178 @@
+/*
+ * idle.c - WFI sleep with TIM5 wakeups & cycle counter correction
+ *
+ * TIM5 free-runs at the APB1 timer clock and a CC1 match ends a sleep at
+ * the deadline, as does SysTick or any other IRQ. The core clock stops in
+ * WFI and DWT->CYCCNT with it, so the time slept is measured on TIM5 and
+ * added back to keep cyclegoal()/cyclecheck() & the profiler honest.
+ * Sleeps are only taken from thread mode - in a handler or before
+ * idle_init() they spin like before.
+ */
+
+#include "idle.h"
+#include "cyclesleep.h"
+#include "irqstat.h"
+
+volatile uint32_t idle_events;
+uint32_t idle_mult, idle_ready;
+idle_stats idle_st;
+uint32_t idle_pct_cyc;
+uint64_t idle_pct_slept;
+
+/*
+ * TIM5 at 84MHz, 32 bits so it wraps every 51s
+ */
+void idle_init(void)
+{
+	__HAL_RCC_TIM5_CLK_ENABLE();
+	TIM5->CR1 = 0;
+	TIM5->PSC = 0;
+	TIM5->ARR = 0xFFFFFFFF;
+	TIM5->DIER = 0;
+	TIM5->EGR = TIM_EGR_UG;
+	TIM5->SR = 0;
+	TIM5->CR1 = TIM_CR1_CEN;
+	idle_mult = SystemCoreClock / (2*HAL_RCC_GetPCLK1Freq());
+
+	HAL_NVIC_SetPriority(TIM5_IRQn, 15, 0);
+	HAL_NVIC_EnableIRQ(TIM5_IRQn);
+
+	idle_pct_cyc = DWT->CYCCNT;
+	idle_ready = 1;
+}
+
+/*
+ * flag work for the main loop from an IRQ
+ */
+void idle_post(uint32_t ev)
+{
+	uint32_t prim;
+
+	IRQ_LOCK(prim);
+	idle_events |= ev;
+	IRQ_UNLOCK(prim);
+}
+
+/*
+ * collect & clear posted events without sleeping
+ */
+uint32_t idle_take(uint32_t mask)
+{
+	uint32_t prim, ev;
+
+	IRQ_LOCK(prim);
+	ev = idle_events & mask;
+	idle_events &= ~ev;
+	IRQ_UNLOCK(prim);
+
+	return ev;
+}
+
+/*
+ * sleep until the cycle counter reaches goal or one of the events in
+ * mask is posted. Returns & clears the events that ended it, 0 on time.
+ */
+uint32_t idle_sleep_until(uint32_t goal, uint32_t mask)
+{
+	uint32_t prim, ev, rem, c0, c1, t0, slept;
+
+	while(1)
+	{
+		/* IRQs stay off from the check to the WFI so no wakeup is lost */
+		IRQ_LOCK(prim);
+		ev = idle_events & mask;
+		rem = goal - DWT->CYCCNT;
+		if(ev || !cyclecheck(goal))
+		{
+			idle_events &= ~ev;
+			IRQ_UNLOCK(prim);
+			return ev;
+		}
+		if(!idle_ready || __get_IPSR() || (rem < IDLE_MINCYC))
+		{
+			IRQ_UNLOCK(prim);
+			continue;
+		}
+
+		/* wake at the deadline if nothing else comes first */
+		c0 = DWT->CYCCNT;
+		t0 = TIM5->CNT;
+		TIM5->SR = ~TIM_SR_CC1IF;
+		TIM5->CCR1 = t0 + rem / idle_mult;
+		TIM5->DIER |= TIM_DIER_CC1IE;
+		__DSB();
+		__WFI();
+
+		/* credit the cycles the counter missed - a few are lost here */
+		slept = (TIM5->CNT - t0) * idle_mult;
+		c1 = DWT->CYCCNT;
+		if(slept > c1 - c0)
+			DWT->CYCCNT += slept - (c1 - c0);
+		idle_st.slept += slept;
+		idle_st.wakes++;
+
+		/* the IRQ that woke us runs here */
+		IRQ_UNLOCK(prim);
+	}
+}
+
+uint32_t idle_sleep_for(uint32_t cycles, uint32_t mask)
+{
+	return idle_sleep_until(cyclegoal(cycles), mask);
+}
+
+/*
+ * share of time spent in WFI, in 0.1% since the last call
+ */
+uint16_t idle_sleep_pct(void)
+{
+	uint32_t now = DWT->CYCCNT, tot = now - idle_pct_cyc;
+	uint64_t slept = idle_st.slept - idle_pct_slept;
+
+	idle_pct_cyc = now;
+	idle_pct_slept = idle_st.slept;
+
+	if(!tot)
+		return 0;
+	if(slept >= tot)
+		return 1000;
+	return (uint16_t)(slept * 1000 / tot);
+}
+
+void idle_get_stats(idle_stats *st)
+{
+	uint32_t prim;
+
+	IRQ_LOCK(prim);
+	*st = idle_st;
+	IRQ_UNLOCK(prim);
+}
+
+/*
+ * replaces the weak HAL tick spin - before idle_init() the cycle counter
+ * may not be running yet so that keeps the original
+ */
+void HAL_Delay(uint32_t Delay)
+{
+	uint32_t tickstart = HAL_GetTick();
+
+	if(!idle_ready || __get_IPSR())
+	{
+		if(Delay < HAL_MAX_DELAY)
+			Delay += (uint32_t)uwTickFreq;
+		while((HAL_GetTick() - tickstart) < Delay)
+			;
+		return;
+	}
+
+	delay(Delay);
+}
+
+/*
+ * deadline wakeup only
+ */
+IRQSTAT_HANDLER(TIM5_IRQHandler)
+{
+	TIM5->SR = ~TIM_SR_CC1IF;
+	TIM5->DIER &= ~TIM_DIER_CC1IE;
+}
@@ -0,0 +1,31 @@
+/*
+ * idle.h - WFI sleep with TIM5 wakeups & cycle counter correction
+ */
+
+#ifndef __idle__
+#define __idle__
+
+#include "stm32f4xx_hal.h"
+
+/* work posted from IRQs that ends a sleep early */
+#define IDLE_EV_RX 0x01
+#define IDLE_EV_ADC 0x02
+
+/* below this many cycles it's not worth sleeping */
+#define IDLE_MINCYC 256
+
+typedef struct
+{
+	uint32_t wakes;
+	uint64_t slept;
+} idle_stats;
+
+void idle_init(void);
+void idle_post(uint32_t ev);
+uint32_t idle_take(uint32_t mask);
+uint32_t idle_sleep_until(uint32_t goal, uint32_t mask);
+uint32_t idle_sleep_for(uint32_t cycles, uint32_t mask);
+uint16_t idle_sleep_pct(void);
+void idle_get_stats(idle_stats *st);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * irqstat.c - per-interrupt timing & interrupts-off window tracking
+ *
+ * Execution time is inclusive - a handler preempted by a higher priority
+ * one is charged for it. Latency needs a timer that restarted when the
+ * interrupt source fired, see irqstat_latency(), and SysTick measures its
+ * own. Only those IRQs get a pending-to-entry latency - there's no way to
+ * see when an arbitrary IRQ went pending, so the rest report none. All
+ * times are in CPU cycles.
+ */
+
+#include <string.h>
+#include "irqstat.h"
+#include "printf.h"
+
+#ifdef IRQSTAT
+
+typedef struct
+{
+	uint32_t count;
+	uint64_t total;
+	uint32_t wcet;
+	uint32_t maxlat;
+	TIM_TypeDef *tim;
+	uint32_t offset;
+	uint8_t mult;
+} irqstat_entry;
+
+typedef struct
+{
+	uint32_t cycles;
+	const char *func;
+	uint16_t line;
+} irqstat_window;
+
+irqstat_entry irqstat_tab[IRQSTAT_NUM];
+irqstat_window irqstat_win[IRQSTAT_WINDOWS];
+uint32_t irqstat_t_reset;
+uint32_t irqstat_lock_t0;
+const char *irqstat_lock_func;
+uint16_t irqstat_lock_line;
+
+/*
+ * entry stamp & latency - returns the stamp for irqstat_exit
+ */
+uint32_t irqstat_enter(void)
+{
+	uint32_t t0 = DWT->CYCCNT, lat;
+	irqstat_entry *e = &irqstat_tab[__get_IPSR() % IRQSTAT_NUM];
+
+	if(e->tim)
+	{
+		lat = e->tim->CNT * e->mult;
+		lat = lat > e->offset ? lat - e->offset : 0;
+	}
+	else if(e == &irqstat_tab[15])
+		lat = SysTick->LOAD - SysTick->VAL;
+	else
+		lat = 0;
+	if(lat > e->maxlat)
+		e->maxlat = lat;
+
+	return t0;
+}
+
+void irqstat_exit(uint32_t t0)
+{
+	uint32_t cyc = DWT->CYCCNT - t0;
+	irqstat_entry *e = &irqstat_tab[__get_IPSR() % IRQSTAT_NUM];
+
+	e->count++;
+	e->total += cyc;
+	if(cyc > e->wcet)
+		e->wcet = cyc;
+}
+
+/*
+ * outermost IRQ_LOCK - IRQs are already off so no one else is in here
+ */
+void irqstat_lock(const char *func, uint16_t line)
+{
+	irqstat_lock_func = func;
+	irqstat_lock_line = line;
+	irqstat_lock_t0 = DWT->CYCCNT;
+}
+
+/*
+ * keep the window if it's one of the longest - sorted longest first
+ */
+void irqstat_unlock(void)
+{
+	uint32_t cyc = DWT->CYCCNT - irqstat_lock_t0;
+	int8_t i;
+
+	if(cyc <= irqstat_win[IRQSTAT_WINDOWS-1].cycles)
+		return;
+
+	/* one entry per call site */
+	for(i=0;i<IRQSTAT_WINDOWS-1;i++)
+		if((irqstat_win[i].func == irqstat_lock_func) &&
+			(irqstat_win[i].line == irqstat_lock_line))
+			break;
+	if(cyc <= irqstat_win[i].cycles)
+		return;
+
+	for(;i>0 && (irqstat_win[i-1].cycles < cyc);i--)
+		irqstat_win[i] = irqstat_win[i-1];
+	irqstat_win[i].cycles = cyc;
+	irqstat_win[i].func = irqstat_lock_func;
+	irqstat_win[i].line = irqstat_lock_line;
+}
+
+/*
+ * latency from a timer that restarts when the IRQ source fires: cycles
+ * = CNT * mult - offset, where offset covers known work between the
+ * timer update and the IRQ request. Only valid below one timer period.
+ */
+void irqstat_latency(IRQn_Type irqn, TIM_TypeDef *tim, uint8_t mult,
+	uint32_t offset)
+{
+	irqstat_entry *e = &irqstat_tab[(irqn + 16) % IRQSTAT_NUM];
+
+	e->tim = tim;
+	e->mult = mult;
+	e->offset = offset;
+}
+
+void irqstat_reset(void)
+{
+	uint32_t prim;
+	uint8_t i;
+
+	IRQ_LOCK(prim);
+	for(i=0;i<IRQSTAT_NUM;i++)
+	{
+		irqstat_tab[i].count = 0;
+		irqstat_tab[i].total = 0;
+		irqstat_tab[i].wcet = 0;
+		irqstat_tab[i].maxlat = 0;
+	}
+	memset(irqstat_win, 0, sizeof(irqstat_win));
+	irqstat_t_reset = HAL_GetTick();
+	IRQ_UNLOCK(prim);
+}
+
+/*
+ * every IRQ that ran since the last reset plus the longest IRQs-off
+ * windows. Rate & load are over the time since the reset.
+ */
+void irqstat_report(void)
+{
+	irqstat_entry e;
+	irqstat_window w[IRQSTAT_WINDOWS];
+	uint32_t ms = HAL_GetTick() - irqstat_t_reset, prim, load;
+	uint8_t i;
+
+	if(!ms)
+		ms = 1;
+	printf("irq    count   rate/s  load%%     wcet   maxlat  (%u ms)\n\r", ms);
+	for(i=0;i<IRQSTAT_NUM;i++)
+	{
+		IRQ_LOCK(prim);
+		e = irqstat_tab[i];
+		IRQ_UNLOCK(prim);
+		if(!e.count)
+			continue;
+
+		/* load in 0.01% */
+		load = e.total * 10000 / ((uint64_t)ms * (SystemCoreClock / 1000));
+		printf("%3d %8u %8u %3u.%02u %8u ", (int8_t)(i - 16), e.count,
+			(uint32_t)((uint64_t)e.count * 1000 / ms), load / 100, load % 100,
+			e.wcet);
+
+		/* no latency source for this IRQ */
+		if(!e.tim && !e.maxlat && (i != 15))
+			printf("       -\n\r");
+		else
+			printf("%8u\n\r", e.maxlat);
+	}
+	printf("maxlat is only measured for SysTick & IRQs with a latency timer\n\r");
+
+	IRQ_LOCK(prim);
+	memcpy(w, irqstat_win, sizeof(w));
+	IRQ_UNLOCK(prim);
+	printf("longest IRQs-off windows\n\r");
+	for(i=0;i<IRQSTAT_WINDOWS && w[i].cycles;i++)
+		printf("%8u %s:%d\n\r", w[i].cycles, w[i].func, w[i].line);
+}
+
+#else
+
+void irqstat_reset(void)
+{
+}
+
+void irqstat_report(void)
+{
+	printf("irqstat not built - define IRQSTAT in irqstat.h\n\r");
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * irqstat.h - per-interrupt timing & interrupts-off window tracking
+ *
+ * Handlers are declared with IRQSTAT_HANDLER(name) so entry & exit get
+ * stamped, and critical sections use IRQ_LOCK/IRQ_UNLOCK so the longest
+ * ones are recorded with their call site. Without IRQSTAT defined it all
+ * reduces to plain handlers and PRIMASK save/restore.
+ */
+
+#ifndef __irqstat__
+#define __irqstat__
+
+#include "stm32f4xx_hal.h"
+
+/* uncomment this to build the instrumentation */
+//#define IRQSTAT
+
+/* exception numbers tracked - 16 system + 82 IRQs */
+#define IRQSTAT_NUM 98
+
+/* longest interrupts-off windows kept */
+#define IRQSTAT_WINDOWS 4
+
+#ifdef IRQSTAT
+
+#define IRQSTAT_HANDLER(name) \
+	static void name##_body(void); \
+	void name(void) \
+	{ \
+		uint32_t t0 = irqstat_enter(); \
+		name##_body(); \
+		irqstat_exit(t0); \
+	} \
+	static inline void name##_body(void)
+
+#define IRQ_LOCK(prim) do { \
+	(prim) = __get_PRIMASK(); \
+	__disable_irq(); \
+	if(!(prim)) \
+		irqstat_lock(__func__, __LINE__); \
+	} while(0)
+
+#define IRQ_UNLOCK(prim) do { \
+	if(!(prim)) \
+		irqstat_unlock(); \
+	__set_PRIMASK(prim); \
+	} while(0)
+
+#define IRQSTAT_LATENCY(irqn, tim, mult, offset) \
+	irqstat_latency(irqn, tim, mult, offset)
+
+uint32_t irqstat_enter(void);
+void irqstat_exit(uint32_t t0);
+void irqstat_lock(const char *func, uint16_t line);
+void irqstat_unlock(void);
+void irqstat_latency(IRQn_Type irqn, TIM_TypeDef *tim, uint8_t mult,
+	uint32_t offset);
+
+#else
+
+#define IRQSTAT_HANDLER(name) void name(void)
+
+#define IRQ_LOCK(prim) do { \
+	(prim) = __get_PRIMASK(); \
+	__disable_irq(); \
+	} while(0)
+
+#define IRQ_UNLOCK(prim) __set_PRIMASK(prim)
+
+#define IRQSTAT_LATENCY(irqn, tim, mult, offset) do{}while(0)
+
+#endif
+
+void irqstat_reset(void);
+void irqstat_report(void);
+
+#endif
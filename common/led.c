@@ -1,10 +1,16 @@
 /*
  * led.c - f405 LED setup
+ *
+ * The NeoPixel on PC0 has no timer channel so the WS2812 waveform comes
+ * from DMA writes to GPIOC->BSRR paced by TIM8 updates. Each bit is three
+ * 417ns slots - set, data, clear - giving 417ns/833ns highs in a 1.25us
+ * bit. A ping-pong buffer of LED_CHUNK pixels per half is refilled from
+ * the caller's colors in the DMA IRQ so strips can be any length, then a
+ * run of idle halves provides the reset before the callback.
  */
 
 #include "led.h"
-#include "cyclesleep.h"
-#include "arm_math.h"
+#include "irqstat.h"
 
 const uint32_t led_colors[8] =
 {
@@ -18,9 +24,30 @@ const uint32_t led_colors[8] =
 	0x010101,	// white
 };
 
+/* slot timing - 3 slots per bit at 800kHz */
+#define LED_SLOT_NS 417
 
+/* pixels per buffer half, BSRR words per half & its duration */
+#define LED_CHUNK 2
+#define LED_HALF (LED_CHUNK*24*3)
+#define LED_HALF_NS (LED_HALF*LED_SLOT_NS)
 
-uint32_t T0H, T0L, T1H, T1L, TRST;
+/* reset time - newer WS2812B parts need 280us */
+#define LED_TRST_US 300
+
+/* BSRR words for PC0 */
+#define LED_SET 1
+#define LED_CLR (1<<16)
+
+/* DMA buffer - can't be in CCM */
+uint32_t led_buf[2*LED_HALF];
+
+/* frame state */
+const uint32_t *led_src;
+uint32_t led_one;
+uint16_t led_num, led_chunk_fill, led_chunk_done, led_chunks, led_data;
+volatile uint8_t led_busy;
+void (*led_cb)(void);
 
 /*
  * Initialize the breakout board LED
@@ -28,7 +55,7 @@ uint32_t T0H, T0L, T1H, T1L, TRST;
 void LEDInit(void)
 {
 	GPIO_InitTypeDef GPIO_InitStructure;
-	float32_t clkfreq;
+	uint32_t timclk;
 	
 	/* Enable GPIO B Clock */
 	__HAL_RCC_GPIOC_CLK_ENABLE();
@@ -39,14 +66,37 @@ void LEDInit(void)
 	GPIO_InitStructure.Speed = GPIO_SPEED_FREQ_LOW;
 	GPIO_InitStructure.Pull = GPIO_NOPULL ;
 	HAL_GPIO_Init(GPIOC, &GPIO_InitStructure);
+	GPIOC->BSRR = LED_CLR;
 	
-	/* pre-compute timing */
-	clkfreq = HAL_RCC_GetSysClockFreq();
-	T0H = floorf(500e-9F * clkfreq + 0.5F)-20;
-	T0L = floorf(2000e-9F * clkfreq + 0.5F)-20;
-	T1H = floorf(1200e-9F * clkfreq + 0.5F)-20;
-	T1L = floorf(1300e-9F * clkfreq + 0.5F)-20;
-	TRST = floorf(50e-6F * clkfreq + 0.5F);
+	/* TIM8 paces the slots - APB2 timers run at 2x PCLK2 when prescaled */
+	__HAL_RCC_TIM8_CLK_ENABLE();
+	timclk = HAL_RCC_GetPCLK2Freq();
+	if((RCC->CFGR & RCC_CFGR_PPRE2) != RCC_HCLK_DIV1)
+		timclk *= 2;
+	TIM8->CR1 = 0;
+	TIM8->PSC = 0;
+	TIM8->ARR = (uint32_t)((uint64_t)timclk * LED_SLOT_NS / 1000000000) - 1;
+	TIM8->RCR = 0;
+	TIM8->DIER = TIM_DIER_UDE;
+	
+	/* DMA2 Stream1 channel 7 is TIM8_UP - words to BSRR, circular */
+	__HAL_RCC_DMA2_CLK_ENABLE();
+	DMA2_Stream1->CR = 0;
+	while(DMA2_Stream1->CR & DMA_SxCR_EN)
+	{
+	}
+	DMA2_Stream1->PAR = (uint32_t)&GPIOC->BSRR;
+	DMA2_Stream1->M0AR = (uint32_t)led_buf;
+	DMA2_Stream1->FCR = 0;
+	DMA2_Stream1->CR = DMA_CHANNEL_7 | DMA_PRIORITY_VERY_HIGH |
+		DMA_MDATAALIGN_WORD | DMA_PDATAALIGN_WORD | DMA_MINC_ENABLE |
+		DMA_CIRCULAR | DMA_MEMORY_TO_PERIPH | DMA_IT_HT | DMA_IT_TC;
+	
+	/* high priority so refills keep ahead of the DMA */
+	HAL_NVIC_SetPriority(DMA2_Stream1_IRQn, 1, 0);
+	HAL_NVIC_EnableIRQ(DMA2_Stream1_IRQn);
+	
+	led_busy = 0;
 }
 
 /*
@@ -74,40 +124,90 @@ void LEDToggle(void)
 }
 
 /*
- * Set RGB value
+ * fill one buffer half with the next chunk of pixels or idle
  */
-void LEDSetColor(uint32_t color)
+static void LEDFill(uint32_t *p)
 {
-	uint8_t i;
+	uint16_t pix = led_chunk_fill * LED_CHUNK, i;
+	uint32_t color;
+	uint8_t b;
 	
-	/* loop over full 24-bit RGB word */
-	__disable_irq();
-	for(i=0;i<24;i++)
+	for(i=0;i<LED_CHUNK;i++,pix++)
 	{
-		/* set output high */
-		GPIOC->BSRR = 1;
-		
-		/* generate pulse for this bit */
-		if(color & (1<<23))
+		if(pix < led_num)
 		{
-			cyclesleep(T1H);
-			GPIOC->BSRR = (1<<16);
-			cyclesleep(T1L);
+			/* 24-bit GRB word MSB first */
+			color = led_src[pix] << 8;
+			for(b=0;b<24;b++)
+			{
+				*p++ = LED_SET;
+				*p++ = (color & 0x80000000) ? 0 : LED_CLR;
+				*p++ = LED_CLR;
+				color <<= 1;
+			}
 		}
 		else
 		{
-			cyclesleep(T0H);
-			GPIOC->BSRR = (1<<16);
-			cyclesleep(T0L);
+			/* line stays low */
+			for(b=0;b<24*3;b++)
+				*p++ = 0;
 		}
-		
-		/* next bit */
-		color <<= 1;
 	}
-	__enable_irq();
+	led_chunk_fill++;
+}
+
+/*
+ * send num 24-bit GRB colors to a strip without blocking. colors must
+ * stay valid until cb is called from the DMA IRQ after the reset time.
+ * Returns nonzero if a frame is still in progress.
+ */
+uint8_t LEDStripWrite(const uint32_t *colors, uint16_t num, void (*cb)(void))
+{
+	if(led_busy || !num)
+		return 1;
+	
+	led_src = colors;
+	led_num = num;
+	led_cb = cb;
+	led_data = (num + LED_CHUNK - 1) / LED_CHUNK;
+	led_chunks = led_data + (LED_TRST_US*1000 + LED_HALF_NS - 1) / LED_HALF_NS;
+	led_chunk_fill = 0;
+	led_chunk_done = 0;
+	led_busy = 1;
+	
+	/* prime both halves */
+	LEDFill(&led_buf[0]);
+	LEDFill(&led_buf[LED_HALF]);
+	
+	/* start from the top of the buffer */
+	DMA2->LIFCR = DMA_LIFCR_CHTIF1 | DMA_LIFCR_CTCIF1 | DMA_LIFCR_CTEIF1 |
+		DMA_LIFCR_CDMEIF1 | DMA_LIFCR_CFEIF1;
+	DMA2_Stream1->NDTR = 2*LED_HALF;
+	DMA2_Stream1->CR |= DMA_SxCR_EN;
+	TIM8->CNT = 0;
+	TIM8->CR1 = TIM_CR1_CEN;
 	
-	/* Built in delay */
-	cyclesleep(TRST);
+	return 0;
+}
+
+/*
+ * nonzero while a frame or its reset time is in progress
+ */
+uint8_t LEDStripBusy(void)
+{
+	return led_busy;
+}
+
+/*
+ * Set RGB value of the single onboard pixel - waits for the last frame
+ */
+void LEDSetColor(uint32_t color)
+{
+	while(led_busy)
+	{
+	}
+	led_one = color;
+	LEDStripWrite(&led_one, 1, NULL);
 }
 
 /*
@@ -117,3 +217,36 @@ void LEDSetIdx(uint8_t idx)
 {
 	LEDSetColor(led_colors[idx&7]);
 }
+
+/*
+ * refill the half that just went out, stop after the reset time
+ */
+IRQSTAT_HANDLER(DMA2_Stream1_IRQHandler)
+{
+	uint32_t *p;
+	
+	if(DMA2->LISR & DMA_LISR_HTIF1)
+	{
+		DMA2->LIFCR = DMA_LIFCR_CHTIF1;
+		p = &led_buf[0];
+	}
+	else if(DMA2->LISR & DMA_LISR_TCIF1)
+	{
+		DMA2->LIFCR = DMA_LIFCR_CTCIF1;
+		p = &led_buf[LED_HALF];
+	}
+	else
+		return;
+	
+	if(++led_chunk_done >= led_chunks)
+	{
+		/* done - line has been low for the reset time */
+		TIM8->CR1 = 0;
+		DMA2_Stream1->CR &= ~DMA_SxCR_EN;
+		led_busy = 0;
+		if(led_cb)
+			led_cb();
+	}
+	else
+		LEDFill(p);
+}
@@ -23,6 +23,8 @@ void LEDInit(void);
 void LEDOn(void);
 void LEDOff(void);
 void LEDToggle(void);
+uint8_t LEDStripWrite(const uint32_t *colors, uint16_t num, void (*cb)(void));
+uint8_t LEDStripBusy(void);
 void LEDSetColor(uint32_t color);
 void LEDSetIdx(uint8_t idx);
 
@@ -0,0 +1,288 @@
+/*
+ * led_anim.c - NeoPixel animation engine
+ *
+ * Colors are 0xRRGGBB. Each frame is built from the current effect at
+ * its phase, scaled by per-pixel and global brightness, gamma corrected
+ * and packed to GRB in whichever of two frame buffers isn't being sent.
+ * LEDAnimUpdate() only starts a frame when it's due and the strip is
+ * idle so it never waits on the DMA. Integer only throughout.
+ */
+
+#include "led_anim.h"
+#include "led.h"
+#include "cyclesleep.h"
+
+/* gamma 2.6 */
+const uint8_t led_gamma[256] =
+{
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	  0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,  1,  1,  1,  1,
+	  1,  1,  1,  1,  2,  2,  2,  2,  2,  2,  2,  2,  3,  3,  3,  3,
+	  3,  3,  4,  4,  4,  4,  5,  5,  5,  5,  5,  6,  6,  6,  6,  7,
+	  7,  7,  8,  8,  8,  9,  9,  9, 10, 10, 10, 11, 11, 11, 12, 12,
+	 13, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18, 19, 19, 20,
+	 20, 21, 21, 22, 22, 23, 24, 24, 25, 25, 26, 27, 27, 28, 29, 29,
+	 30, 31, 31, 32, 33, 34, 34, 35, 36, 37, 38, 38, 39, 40, 41, 42,
+	 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57,
+	 58, 59, 60, 61, 62, 63, 64, 65, 66, 68, 69, 70, 71, 72, 73, 75,
+	 76, 77, 78, 80, 81, 82, 84, 85, 86, 88, 89, 90, 92, 93, 94, 96,
+	 97, 99,100,102,103,105,106,108,109,111,112,114,115,117,119,120,
+	122,124,125,127,129,130,132,134,136,137,139,141,143,145,146,148,
+	150,152,154,156,158,160,162,164,166,168,170,172,174,176,178,180,
+	182,184,186,188,191,193,195,197,199,202,204,206,209,211,213,215,
+	218,220,223,225,227,230,232,235,237,240,242,245,247,250,252,255,
+};
+
+/* strip state */
+uint16_t anim_npix, anim_period, anim_frames;
+uint32_t anim_rgb[LED_ANIM_MAXPIX];
+uint8_t anim_bright[LED_ANIM_MAXPIX], anim_global;
+
+/* double-buffered GRB output */
+uint32_t anim_out[2][LED_ANIM_MAXPIX];
+uint8_t anim_outidx;
+
+/* effect & frame timing */
+uint8_t anim_fx, anim_tail;
+uint32_t anim_c0, anim_c1, anim_frame, anim_goal, anim_frame_cyc;
+uint32_t anim_cycles;
+
+/*
+ * blend two colors - frac 0 to 256
+ */
+static uint32_t LEDAnimMix(uint32_t a, uint32_t b, uint32_t frac)
+{
+	uint32_t r, g, bl;
+
+	r = (((a >> 16) & 0xFF) * (256 - frac) + ((b >> 16) & 0xFF) * frac) >> 8;
+	g = (((a >> 8) & 0xFF) * (256 - frac) + ((b >> 8) & 0xFF) * frac) >> 8;
+	bl = ((a & 0xFF) * (256 - frac) + (b & 0xFF) * frac) >> 8;
+
+	return (r << 16) | (g << 8) | bl;
+}
+
+/*
+ * scale a color by 0 to 256
+ */
+static uint32_t LEDAnimScale(uint32_t c, uint32_t scl)
+{
+	return ((((c >> 16) & 0xFF) * scl >> 8) << 16) |
+		((((c >> 8) & 0xFF) * scl >> 8) << 8) |
+		((c & 0xFF) * scl >> 8);
+}
+
+/*
+ * set up for a strip of npix pixels updated at fps
+ */
+void LEDAnimInit(uint16_t npix, uint16_t fps)
+{
+	uint16_t i;
+
+	if(npix > LED_ANIM_MAXPIX)
+		npix = LED_ANIM_MAXPIX;
+	if(fps == 0)
+		fps = 1;
+
+	anim_npix = npix;
+	for(i=0;i<LED_ANIM_MAXPIX;i++)
+	{
+		anim_rgb[i] = 0;
+		anim_bright[i] = 255;
+	}
+	anim_global = 255;
+	anim_outidx = 0;
+	anim_fx = LED_ANIM_STATIC;
+	anim_frame_cyc = SystemCoreClock / fps;
+	anim_frame = 0;
+	anim_frames = 1;
+	anim_goal = cyclegoal(0);
+}
+
+/*
+ * fixed-point HSV - h is 0-65535 around the wheel, s & v are 0-255
+ */
+uint32_t LEDAnimHSV(uint16_t h, uint8_t s, uint8_t v)
+{
+	uint32_t sector, f, p, q, t;
+
+	/* six sectors of 10923 with an 8-bit fraction */
+	sector = ((uint32_t)h * 6) >> 16;
+	f = (((uint32_t)h * 6) >> 8) & 0xFF;
+
+	p = (v * (255 - s) + 127) / 255;
+	q = (v * (255 - ((s * f + 127) / 255)) + 127) / 255;
+	t = (v * (255 - ((s * (255 - f) + 127) / 255)) + 127) / 255;
+
+	switch(sector)
+	{
+		case 0: return (v << 16) | (t << 8) | p;
+		case 1: return (q << 16) | (v << 8) | p;
+		case 2: return (p << 16) | (v << 8) | t;
+		case 3: return (p << 16) | (q << 8) | v;
+		case 4: return (t << 16) | (p << 8) | v;
+		default: return (v << 16) | (p << 8) | q;
+	}
+}
+
+/*
+ * set one pixel for the static effect
+ */
+void LEDAnimSetPixel(uint16_t pix, uint32_t rgb)
+{
+	if(pix < anim_npix)
+		anim_rgb[pix] = rgb;
+}
+
+/*
+ * per-pixel brightness 0-255
+ */
+void LEDAnimSetBright(uint16_t pix, uint8_t bright)
+{
+	if(pix < anim_npix)
+		anim_bright[pix] = bright;
+}
+
+/*
+ * whole strip brightness 0-255
+ */
+void LEDAnimSetGlobal(uint8_t bright)
+{
+	anim_global = bright;
+}
+
+/*
+ * start an effect lasting ms per cycle
+ */
+static void LEDAnimStart(uint8_t fx, uint16_t ms)
+{
+	uint32_t frames = (uint64_t)ms * SystemCoreClock / 1000 / anim_frame_cyc;
+
+	anim_fx = fx;
+	anim_frames = frames ? frames : 1;
+	anim_frame = 0;
+}
+
+/*
+ * show the pixels as set
+ */
+void LEDAnimStatic(void)
+{
+	LEDAnimStart(LED_ANIM_STATIC, 0);
+}
+
+/*
+ * blend the whole strip from one color to another over ms then hold
+ */
+void LEDAnimFade(uint32_t from, uint32_t to, uint16_t ms)
+{
+	anim_c0 = from;
+	anim_c1 = to;
+	LEDAnimStart(LED_ANIM_FADE, ms);
+}
+
+/*
+ * ramp a color up & down every ms
+ */
+void LEDAnimBreathe(uint32_t rgb, uint16_t ms)
+{
+	anim_c0 = rgb;
+	LEDAnimStart(LED_ANIM_BREATHE, ms);
+}
+
+/*
+ * run a pixel along the strip every ms with a tail of tail pixels
+ */
+void LEDAnimChase(uint32_t rgb, uint16_t ms, uint8_t tail)
+{
+	anim_c0 = rgb;
+	anim_tail = tail ? tail : 1;
+	LEDAnimStart(LED_ANIM_CHASE, ms);
+}
+
+/*
+ * scroll the hue wheel along the strip every ms
+ */
+void LEDAnimRainbow(uint16_t ms)
+{
+	LEDAnimStart(LED_ANIM_RAINBOW, ms);
+}
+
+/*
+ * effect color of one pixel at phase 0-65535
+ */
+static uint32_t LEDAnimPixel(uint16_t pix, uint32_t phase)
+{
+	uint32_t d, head;
+
+	switch(anim_fx)
+	{
+		case LED_ANIM_FADE:
+			/* one-shot so stops at the end */
+			if(anim_frame >= anim_frames)
+				return anim_c1;
+			return LEDAnimMix(anim_c0, anim_c1, phase >> 8);
+
+		case LED_ANIM_BREATHE:
+			/* triangle - gamma makes it look smooth */
+			d = phase >> 7;
+			return LEDAnimScale(anim_c0, d < 256 ? d : 511 - d);
+
+		case LED_ANIM_CHASE:
+			head = (phase * anim_npix) >> 16;
+			d = (head + anim_npix - pix) % anim_npix;
+			if(d >= anim_tail)
+				return 0;
+			return LEDAnimScale(anim_c0, 256 - d * 256 / anim_tail);
+
+		case LED_ANIM_RAINBOW:
+			return LEDAnimHSV(phase + pix * 65536 / anim_npix, 255, 255);
+
+		default:
+			return anim_rgb[pix];
+	}
+}
+
+/*
+ * call from the main loop - builds & sends a frame when one is due
+ */
+void LEDAnimUpdate(void)
+{
+	uint32_t start, phase, c, scl;
+	uint32_t *out;
+	uint16_t i;
+
+	if(cyclecheck(anim_goal) || LEDStripBusy())
+		return;
+
+	/* next frame on schedule, or from now if we fell behind */
+	anim_goal += anim_frame_cyc;
+	if(!cyclecheck(anim_goal))
+		anim_goal = cyclegoal(anim_frame_cyc);
+
+	start = DWT->CYCCNT;
+	phase = ((anim_frame % anim_frames) << 16) / anim_frames;
+	out = anim_out[anim_outidx];
+	for(i=0;i<anim_npix;i++)
+	{
+		c = LEDAnimPixel(i, phase);
+
+		/* brightness then gamma, packed GRB for the strip */
+		scl = (anim_bright[i] * anim_global + 255) >> 8;
+		out[i] = (led_gamma[(((c >> 8) & 0xFF) * scl) >> 8] << 16) |
+			(led_gamma[(((c >> 16) & 0xFF) * scl) >> 8] << 8) |
+			led_gamma[((c & 0xFF) * scl) >> 8];
+	}
+	anim_frame++;
+	anim_cycles = DWT->CYCCNT - start;
+
+	LEDStripWrite(out, anim_npix, NULL);
+	anim_outidx ^= 1;
+}
+
+/*
+ * cycles spent building the last frame
+ */
+uint32_t LEDAnimGetCycles(void)
+{
+	return anim_cycles;
+}
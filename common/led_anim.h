@@ -0,0 +1,36 @@
+/*
+ * led_anim.h - NeoPixel animation engine
+ */
+
+#ifndef __led_anim__
+#define __led_anim__
+
+#include "stm32f4xx_hal.h"
+
+/* longest strip */
+#define LED_ANIM_MAXPIX 64
+
+/* effects */
+enum led_anim_fx
+{
+	LED_ANIM_STATIC,        // pixels as set
+	LED_ANIM_FADE,          // one-shot blend from one color to another
+	LED_ANIM_BREATHE,       // color ramping up & down
+	LED_ANIM_CHASE,         // lit pixel with a fading tail
+	LED_ANIM_RAINBOW,       // hue wheel scrolling along the strip
+};
+
+void LEDAnimInit(uint16_t npix, uint16_t fps);
+uint32_t LEDAnimHSV(uint16_t h, uint8_t s, uint8_t v);
+void LEDAnimSetPixel(uint16_t pix, uint32_t rgb);
+void LEDAnimSetBright(uint16_t pix, uint8_t bright);
+void LEDAnimSetGlobal(uint8_t bright);
+void LEDAnimStatic(void);
+void LEDAnimFade(uint32_t from, uint32_t to, uint16_t ms);
+void LEDAnimBreathe(uint32_t rgb, uint16_t ms);
+void LEDAnimChase(uint32_t rgb, uint16_t ms, uint8_t tail);
+void LEDAnimRainbow(uint16_t ms);
+void LEDAnimUpdate(void);
+uint32_t LEDAnimGetCycles(void);
+
+#endif
@@ -70,7 +70,7 @@ uint32_t oled_command(uint8_t cmd)
 	i2c_msg[1] = cmd;
 
 	/* send command */
-	status = HAL_I2C_Master_Transmit(&hi2c1, SSD1306_I2C_ADDRESS, i2c_msg, 2, 100);
+	status = shared_i2c_write(SSD1306_I2C_ADDRESS, i2c_msg, 2, 100);
 
 	/* Check the communication status */
 	if(status != HAL_OK)
@@ -101,7 +101,7 @@ uint32_t oled_data(uint8_t *data, uint8_t sz)
 		i2c_msg[i+1] = *data++;
 
 	/* send command */
-	status = HAL_I2C_Master_Transmit(&hi2c1, SSD1306_I2C_ADDRESS, i2c_msg, sz+1, 100);
+	status = shared_i2c_write(SSD1306_I2C_ADDRESS, i2c_msg, sz+1, 100);
 
 	/* Check the communication status */
 	if(status != HAL_OK)
@@ -112,85 +112,99 @@ uint32_t oled_data(uint8_t *data, uint8_t sz)
 	return status;
 }
 
-/*
- * Initialize the SSD1306
- */
-uint8_t oled_init(void)
+/* controller init commands */
+static const uint8_t oled_initlst[] =
 {
-	/* clear the frame buffer */
-	oled_clear(0,0);
-		
 #ifdef TINY_OLED
 	/* Init the OLED controller for 64x32 */
-    oled_command(SSD1306_DISPLAYOFF);                    // 0xAE
-    oled_command(SSD1306_SETDISPLAYCLOCKDIV);            // 0xD5
-    oled_command(0x80);                                  // the suggested ratio 0x80
-    oled_command(SSD1306_SETMULTIPLEX);                  // 0xA8
-    oled_command(0x1F);                                  // different for tiny
-    oled_command(SSD1306_SETDISPLAYOFFSET);              // 0xD3
-    oled_command(0x00);                                   // no offset
-	oled_command(SSD1306_SETSTARTLINE | 0x0);            // 0x40 | line
-    oled_command(SSD1306_CHARGEPUMP);                    // 0x8D
-	oled_command(0x14);                                  // enable?
-    oled_command(SSD1306_MEMORYMODE);                    // 0x20
-    oled_command(0x00);                                  // 0x0 act like ks0108
-    oled_command(SSD1306_SEGREMAP | 0x1);                // 0xA0 | bit
-    oled_command(SSD1306_COMSCANDEC);
-    oled_command(SSD1306_SETCOMPINS);                    // 0xDA
-    oled_command(0x12);
-    oled_command(SSD1306_SETCONTRAST);                   // 0x81
-	oled_command(0x8F);
-    oled_command(SSD1306_SETPRECHARGE);                  // 0xd9
-	oled_command(0xF1);
-    oled_command(SSD1306_SETVCOMDETECT);                 // 0xDB
-    oled_command(0x40);
-    oled_command(SSD1306_DISPLAYALLON_RESUME);           // 0xA4
-    oled_command(SSD1306_NORMALDISPLAY);                 // 0xA6
-	oled_command(SSD1306_DISPLAYON);	                 // 0xAF --turn on oled panel
+    SSD1306_DISPLAYOFF,                    // 0xAE
+    SSD1306_SETDISPLAYCLOCKDIV,            // 0xD5
+    0x80,                                  // the suggested ratio 0x80
+    SSD1306_SETMULTIPLEX,                  // 0xA8
+    0x1F,                                  // different for tiny
+    SSD1306_SETDISPLAYOFFSET,              // 0xD3
+    0x00,                                   // no offset
+	SSD1306_SETSTARTLINE | 0x0,            // 0x40 | line
+    SSD1306_CHARGEPUMP,                    // 0x8D
+	0x14,                                  // enable?
+    SSD1306_MEMORYMODE,                    // 0x20
+    0x00,                                  // 0x0 act like ks0108
+    SSD1306_SEGREMAP | 0x1,                // 0xA0 | bit
+    SSD1306_COMSCANDEC,
+    SSD1306_SETCOMPINS,                    // 0xDA
+    0x12,
+    SSD1306_SETCONTRAST,                   // 0x81
+	0x8F,
+    SSD1306_SETPRECHARGE,                  // 0xd9
+	0xF1,
+    SSD1306_SETVCOMDETECT,                 // 0xDB
+    0x40,
+    SSD1306_DISPLAYALLON_RESUME,           // 0xA4
+    SSD1306_NORMALDISPLAY,                 // 0xA6
+	SSD1306_DISPLAYON,	                   // 0xAF --turn on oled panel
 #else
 	/* Init the OLED controller for 128x64 */
-    if(oled_command(SSD1306_DISPLAYOFF)!=HAL_OK)
-		return 1;                    // 0xAE
-	
-    oled_command(SSD1306_SETDISPLAYCLOCKDIV);            // 0xD5
-    oled_command(0x80);                                  // the suggested ratio 0x80
-    oled_command(SSD1306_SETMULTIPLEX);                  // 0xA8
-    oled_command(0x3F);
-    oled_command(SSD1306_SETDISPLAYOFFSET);              // 0xD3
-    oled_command(0x0);                                   // no offset
-    oled_command(SSD1306_SETSTARTLINE | 0x0);            // line #0
-    oled_command(SSD1306_CHARGEPUMP);                    // 0x8D
-    if (vccstate == SSD1306_EXTERNALVCC) 
-		oled_command(0x10);
-    else 
-		oled_command(0x14);
-    oled_command(SSD1306_MEMORYMODE);                    // 0x20
-    oled_command(0x00);                                  // 0x0 act like ks0108
-    oled_command(SSD1306_SEGREMAP | 0x1);
-    oled_command(SSD1306_COMSCANDEC);
-    oled_command(SSD1306_SETCOMPINS);                    // 0xDA
-    oled_command(0x02);
-    oled_command(SSD1306_SETCONTRAST);                   // 0x81
-    if (vccstate == SSD1306_EXTERNALVCC) 
-		oled_command(0x9F);
-    else 
-		oled_command(0x8F);
-    oled_command(SSD1306_SETPRECHARGE);                  // 0xd9
-    if (vccstate == SSD1306_EXTERNALVCC) 
-		oled_command(0x22);
-    else 
-		oled_command(0xF1);
-    oled_command(SSD1306_SETVCOMDETECT);                 // 0xDB
-    oled_command(0x40);
-    oled_command(SSD1306_DISPLAYALLON_RESUME);           // 0xA4
-    oled_command(SSD1306_NORMALDISPLAY);                 // 0xA6
-	
-	oled_command(SSD1306_DISPLAYON);	                 // 0xAF --turn on oled panel
+    SSD1306_DISPLAYOFF,                    // 0xAE
+    SSD1306_SETDISPLAYCLOCKDIV,            // 0xD5
+    0x80,                                  // the suggested ratio 0x80
+    SSD1306_SETMULTIPLEX,                  // 0xA8
+    0x3F,
+    SSD1306_SETDISPLAYOFFSET,              // 0xD3
+    0x0,                                   // no offset
+    SSD1306_SETSTARTLINE | 0x0,            // line #0
+    SSD1306_CHARGEPUMP,                    // 0x8D
+    vccstate == SSD1306_EXTERNALVCC ? 0x10 : 0x14,
+    SSD1306_MEMORYMODE,                    // 0x20
+    0x00,                                  // 0x0 act like ks0108
+    SSD1306_SEGREMAP | 0x1,
+    SSD1306_COMSCANDEC,
+    SSD1306_SETCOMPINS,                    // 0xDA
+    0x02,
+    SSD1306_SETCONTRAST,                   // 0x81
+    vccstate == SSD1306_EXTERNALVCC ? 0x9F : 0x8F,
+    SSD1306_SETPRECHARGE,                  // 0xd9
+    vccstate == SSD1306_EXTERNALVCC ? 0x22 : 0xF1,
+    SSD1306_SETVCOMDETECT,                 // 0xDB
+    0x40,
+    SSD1306_DISPLAYALLON_RESUME,           // 0xA4
+    SSD1306_NORMALDISPLAY,                 // 0xA6
+	SSD1306_DISPLAYON,	                   // 0xAF --turn on oled panel
 #endif
+};
+
+/*
+ * Initialize the SSD1306 - yields between commands so other threads
+ * get the bus, PT_EXITED if the OLED doesn't answer
+ */
+uint8_t oled_init_pt(pt_ctx *pt)
+{
+	static uint8_t i;
+
+	PT_BEGIN(pt);
+
+	/* clear the frame buffer */
+	oled_clear(0,0);
+
+	for(i=0;i<sizeof(oled_initlst);i++)
+	{
+		if(oled_command(oled_initlst[i])!=HAL_OK)
+			PT_EXIT(pt);
+		PT_YIELD(pt);
+	}
 	
 	/* update the display */
 	oled_refresh(0);
-	return 0;
+
+	PT_END(pt);
+}
+
+uint8_t oled_init(void)
+{
+	pt_ctx pt;
+
+	PT_RUN(&pt, oled_init_pt(&pt));
+
+	return pt.state != PT_ENDED;
 }
 
 /*
@@ -7,6 +7,7 @@
 #define __oled__
 
 #include "stm32f4xx.h"
+#include "pt.h"
 
 //#define TINY_OLED
 #ifdef TINY_OLED
@@ -29,6 +30,7 @@ enum oled_dirs
 	OLED_DOWN
 };
 
+uint8_t oled_init_pt(pt_ctx *pt);
 uint8_t oled_init(void);
 uint8_t *oled_get_fb(uint8_t buf_num);
 void oled_cpy_buf(uint8_t dst_num, uint8_t src_num);
@@ -0,0 +1,118 @@
+/*
+ * pcsamp.c - statistical PC sampling profiler on TIM7
+ *
+ * TIM7 interrupts at the highest priority and records the PC & LR that
+ * the core stacked on entry, so it lands inside other IRQ handlers, HAL
+ * busy-waits and everything else alike. Capture stops when the buffer is
+ * full rather than wrapping as a ring, so a dump is always the first
+ * PCSAMP_MAX samples after the start and never races the ISR. pcsamp_dump()
+ * prints the samples for tools/pcsym.c to resolve against main.elf.
+ */
+
+#include "pcsamp.h"
+#include "printf.h"
+
+/* CPU-only so it can go in CCM */
+uint32_t pcsamp_buf[PCSAMP_MAX][2] __attribute__ ((section (".ccmram")));
+volatile uint32_t pcsamp_num;
+uint32_t pcsamp_rate;
+
+/*
+ * TIM7 runs from 84MHz, IRQ at priority 0
+ */
+void pcsamp_init(void)
+{
+	__HAL_RCC_TIM7_CLK_ENABLE();
+	TIM7->CR1 = 0;
+	TIM7->DIER = TIM_DIER_UIE;
+
+	HAL_NVIC_SetPriority(TIM7_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(TIM7_IRQn);
+	pcsamp_num = 0;
+}
+
+/*
+ * clear the buffer & start sampling - returns the actual rate
+ */
+uint32_t pcsamp_start(uint32_t rate)
+{
+	uint32_t tick = PCSAMP_TICK_FAST;
+
+	if(!rate)
+		rate = PCSAMP_RATE_DEFAULT;
+	if(rate > PCSAMP_RATE_MAX)
+		rate = PCSAMP_RATE_MAX;
+
+	/* 16-bit ARR - slow rates need the coarser tick */
+	if(tick/rate > 0x10000)
+		tick = PCSAMP_TICK_SLOW;
+
+	TIM7->CR1 = TIM_CR1_URS;
+	pcsamp_num = 0;
+	TIM7->PSC = (2*HAL_RCC_GetPCLK1Freq())/tick - 1;
+	TIM7->ARR = tick/rate - 1;
+
+	/* load PSC & clear CNT - URS keeps this from raising the IRQ */
+	TIM7->EGR = TIM_EGR_UG;
+	TIM7->SR = 0;
+	TIM7->CR1 = TIM_CR1_URS | TIM_CR1_CEN;
+	pcsamp_rate = tick/(TIM7->ARR + 1);
+
+	return pcsamp_rate;
+}
+
+void pcsamp_stop(void)
+{
+	TIM7->CR1 = 0;
+}
+
+uint32_t pcsamp_count(void)
+{
+	return pcsamp_num;
+}
+
+/*
+ * print the capture as PCS lines between markers
+ */
+void pcsamp_dump(void)
+{
+	uint32_t i, num = pcsamp_num;
+
+	printf("PCS begin %u %u\n\r", num, pcsamp_rate);
+	for(i=0;i<num;i++)
+		printf("PCS %08X %08X\n\r", pcsamp_buf[i][0], pcsamp_buf[i][1]);
+	printf("PCS end\n\r");
+}
+
+/*
+ * frame points at the stacked R0-R3, R12, LR, PC, xPSR
+ */
+void __attribute__ ((used)) pcsamp_isr(uint32_t *frame)
+{
+	TIM7->SR = 0;
+
+	if(pcsamp_num < PCSAMP_MAX)
+	{
+		pcsamp_buf[pcsamp_num][0] = frame[6];
+		pcsamp_buf[pcsamp_num][1] = frame[5];
+		pcsamp_num++;
+	}
+	else
+		TIM7->CR1 = 0;
+}
+
+/*
+ * find the stack the core pushed to and pass the frame on - naked so
+ * nothing else is pushed first and LR still holds EXC_RETURN
+ */
+void __attribute__ ((naked)) TIM7_IRQHandler(void)
+{
+	__asm volatile
+	(
+		"tst lr, #4\n"
+		"ite eq\n"
+		"mrseq r0, msp\n"
+		"mrsne r0, psp\n"
+		"b pcsamp_isr\n"
+	);
+}
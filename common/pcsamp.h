@@ -0,0 +1,30 @@
+/*
+ * pcsamp.h - statistical PC sampling profiler on TIM7
+ *
+ * A capture fills PCSAMP_MAX samples from pcsamp_start() and then stops,
+ * it doesn't keep the latest ones in a ring.
+ */
+
+#ifndef __pcsamp__
+#define __pcsamp__
+
+#include "stm32f4xx_hal.h"
+
+/* samples per capture - each is a PC & LR pair, not a ring */
+#define PCSAMP_MAX 1024
+
+/* default & max sample rates in Hz, anything down to 1Hz works */
+#define PCSAMP_RATE_DEFAULT 1000
+#define PCSAMP_RATE_MAX 50000
+
+/* timer ticks in Hz - 1MHz down to 16Hz, then 10kHz below that */
+#define PCSAMP_TICK_FAST 1000000
+#define PCSAMP_TICK_SLOW 10000
+
+void pcsamp_init(void);
+uint32_t pcsamp_start(uint32_t rate);
+void pcsamp_stop(void);
+uint32_t pcsamp_count(void);
+void pcsamp_dump(void);
+
+#endif
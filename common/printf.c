@@ -20,44 +20,138 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
 #include "printf.h"
+#include <stdint.h>
 
 typedef void (*putcf) (void*,char);
 static putcf stdout_putf;
 static void* stdout_putp;
 
-#define PRINTF_LONG_SUPPORT
+#define PRINTF_FLOAT_SUPPORT
 
-#ifdef PRINTF_LONG_SUPPORT
+/*
+Numbers are converted back to front into the end of a buffer. Base 10
+takes two digits per step from a pair table, and /100 is a reciprocal
+multiply that is exact for any 32-bit value, so there is no divide
+instruction and no search for the leading power of the base.
+*/
+
+static const char dig2[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
 
-static void uli2a(unsigned long int num, unsigned int base, int uc,char * bf)
+#define DIV100(n) ((uint32_t)(((uint64_t)(n)*0x51EB851FU)>>37))
+
+static char* u10(uint32_t num, char* end)
     {
-    int n=0;
-    unsigned int d=1;
-    while (num/d >= base)
-        d*=base;         
-    while (d!=0) {
-        int dgt = num / d;
-        num%=d;
-        d/=base;
-        if (n || dgt>0|| d==0) {
-            *bf++ = dgt+(dgt<10 ? '0' : (uc ? 'A' : 'a')-10);
-            ++n;
-            }
+    uint32_t q;
+    const char* d;
+    while (num>=100) {
+        q=DIV100(num);
+        d=&dig2[2*(num-100*q)];
+        *--end=d[1];
+        *--end=d[0];
+        num=q;
         }
-    *bf=0;
+    if (num>=10) {
+        *--end=dig2[2*num+1];
+        *--end=dig2[2*num];
+        }
+    else
+        *--end='0'+num;
+    return end;
+    }
+
+/* 64-bit values peel off 9 digits at a time with one long divide each */
+static char* u10ll(unsigned long long num, char* end)
+    {
+    unsigned long long q;
+    char* p;
+    while (num>>32) {
+        q=num/1000000000U;
+        p=u10((uint32_t)(num-q*1000000000U),end);
+        while (p>end-9)
+            *--p='0';
+        end=p;
+        num=q;
+        }
+    return u10((uint32_t)num,end);
+    }
+
+static char* u16(unsigned long long num, int uc, char* end)
+    {
+    const char* dg= uc ? "0123456789ABCDEF" : "0123456789abcdef";
+    do {
+        *--end=dg[num&15];
+        num>>=4;
+        } while (num);
+    return end;
     }
 
-static void li2a (long num, char * bf)
+#ifdef PRINTF_FLOAT_SUPPORT
+
+static const uint32_t pow10i[10] =
+    {
+    1, 10, 100, 1000, 10000, 100000,
+    1000000, 10000000, 100000000, 1000000000
+    };
+
+/*
+Fixed point with prec (0-9) decimals. The arithmetic is single precision
+on the FPU so only ~7 significant digits are meaningful.
+*/
+static char* f2a(float f, int prec, char* end)
     {
-    if (num<0) {
-        num=-num;
-        *bf++ = '-';
+    unsigned long long ip;
+    uint32_t frac=0, scale=pow10i[prec];
+    char neg=0;
+    char* p;
+    if (f!=f) {
+        end-=3;
+        end[0]='n'; end[1]='a'; end[2]='n';
+        return end;
+        }
+    if (f<0) {
+        neg=1;
+        f=-f;
+        }
+    if (f>=1.8e19F) {
+        end-=3;
+        end[0]='i'; end[1]='n'; end[2]='f';
+        }
+    else {
+        if (f<4294967296.0F) {
+            /* fast path - FPU conversions only */
+            ip=(uint32_t)f;
+            frac=(uint32_t)((f-(float)(uint32_t)ip)*(float)scale+0.5F);
+            if (frac>=scale) {
+                frac-=scale;
+                ip++;
+                }
+            }
+        else
+            ip=(unsigned long long)f;
+        if (prec) {
+            p=u10(frac,end);
+            while (p>end-prec)
+                *--p='0';
+            *--p='.';
+            end=p;
+            }
+        end=u10ll(ip,end);
         }
-    uli2a(num,10,0,bf);
+    if (neg)
+        *--end='-';
+    return end;
     }
 
 #endif
 
+#ifdef PRINTF_BENCHMARK
+
+/* the original conversion, kept to measure against */
 static void ui2a(unsigned int num, unsigned int base, int uc,char * bf)
     {
     int n=0;
@@ -76,14 +170,7 @@ static void ui2a(unsigned int num, unsigned int base, int uc,char * bf)
     *bf=0;
     }
 
-static void i2a (int num, char * bf)
-    {
-    if (num<0) {
-        num=-num;
-        *bf++ = '-';
-        }
-    ui2a(num,10,0,bf);
-    }
+#endif
 
 static int a2d(char ch)
     {
@@ -102,7 +189,7 @@ static char a2i(char ch, char** src,int base,int* nump)
     int num=0;
     int digit;
     while ((digit=a2d(ch))>=0) {
-        if (digit>base) break;
+        if (digit>=base) break;
         num=num*base+digit;
         ch=*p++;
         }
@@ -111,86 +198,118 @@ static char a2i(char ch, char** src,int base,int* nump)
     return ch;
     }
 
-static void putchw(void* putp,putcf putf,int n, char z, char* bf)
+static void putchw(void* putp,putcf putf,int n, char z, char left, char* bf)
     {
     char fc=z? '0' : ' ';
     char ch;
     char* p=bf;
     while (*p++ && n > 0)
         n--;
-    while (n-- > 0) 
+    if (z && *bf=='-') 
+        putf(putp,*bf++);
+    while (!left && n-- > 0) 
         putf(putp,fc);
     while ((ch= *bf++))
         putf(putp,ch);
+    while (left && n-- > 0) 
+        putf(putp,' ');
     }
 
 void tfp_format(void* putp,putcf putf,char *fmt, va_list va)
     {
-    char bf[12];
-    
+    char bf[32];
+    char* const end=&bf[sizeof(bf)-1];
+    char* p;
     char ch;
 
-
+    *end=0;
     while ((ch=*(fmt++))) {
         if (ch!='%') 
             putf(putp,ch);
         else {
             char lz=0;
-#ifdef  PRINTF_LONG_SUPPORT
+            char left=0;
             char lng=0;
-#endif
             int w=0;
+            int prec=-1;
+            unsigned long long u;
+            long long s;
             ch=*(fmt++);
+            if (ch=='-') {
+                ch=*(fmt++);
+                left=1;
+                }
             if (ch=='0') {
                 ch=*(fmt++);
-                lz=1;
+                lz=!left;
                 }
             if (ch>='0' && ch<='9') {
                 ch=a2i(ch,&fmt,10,&w);
                 }
-#ifdef  PRINTF_LONG_SUPPORT
-            if (ch=='l') {
+            if (ch=='.') {
                 ch=*(fmt++);
-                lng=1;
-            }
-#endif
+                prec=0;
+                if (ch>='0' && ch<='9') 
+                    ch=a2i(ch,&fmt,10,&prec);
+                }
+            while (ch=='l') {
+                ch=*(fmt++);
+                lng++;
+                }
             switch (ch) {
                 case 0: 
                     goto abort;
-                case 'u' : {
-#ifdef  PRINTF_LONG_SUPPORT
-                    if (lng)
-                        uli2a(va_arg(va, unsigned long int),10,0,bf);
+                case 'u' : 
+                case 'x' : case 'X' : {
+                    if (lng>1)
+                        u=va_arg(va, unsigned long long);
+                    else if (lng)
+                        u=va_arg(va, unsigned long);
                     else
-#endif
-                    ui2a(va_arg(va, unsigned int),10,0,bf);
-                    putchw(putp,putf,w,lz,bf);
+                        u=va_arg(va, unsigned int);
+                    p= ch=='u' ? u10ll(u,end) : u16(u,(ch=='X'),end);
+                    putchw(putp,putf,w,lz,left,p);
                     break;
                     }
-                case 'd' :  {
-#ifdef  PRINTF_LONG_SUPPORT
-                    if (lng)
-                        li2a(va_arg(va, unsigned long int),bf);
+                case 'd' : 
+                case 'i' : {
+                    if (lng>1)
+                        s=va_arg(va, long long);
+                    else if (lng)
+                        s=va_arg(va, long);
                     else
-#endif
-                    i2a(va_arg(va, int),bf);
-                    putchw(putp,putf,w,lz,bf);
+                        s=va_arg(va, int);
+                    p=u10ll(s<0 ? -(unsigned long long)s : (unsigned long long)s,end);
+                    if (s<0)
+                        *--p='-';
+                    putchw(putp,putf,w,lz,left,p);
                     break;
                     }
-                case 'x': case 'X' : 
-#ifdef  PRINTF_LONG_SUPPORT
-                    if (lng)
-                        uli2a(va_arg(va, unsigned long int),16,(ch=='X'),bf);
-                    else
-#endif
-                    ui2a(va_arg(va, unsigned int),16,(ch=='X'),bf);
-                    putchw(putp,putf,w,lz,bf);
+                case 'p' : {
+                    p=u16((uintptr_t)va_arg(va, void*),1,end);
+                    while (p>end-8)
+                        *--p='0';
+                    *--p='x';
+                    *--p='0';
+                    putchw(putp,putf,w,0,left,p);
+                    break;
+                    }
+#ifdef PRINTF_FLOAT_SUPPORT
+                case 'f' : {
+                    if (prec<0)
+                        prec=6;
+                    else if (prec>9)
+                        prec=9;
+                    p=f2a((float)va_arg(va, double),prec,end);
+                    putchw(putp,putf,w,lz,left,p);
                     break;
+                    }
+#endif
                 case 'c' : 
                     putf(putp,(char)(va_arg(va, int)));
                     break;
                 case 's' : 
-                    putchw(putp,putf,w,0,va_arg(va, char*));
+                    putchw(putp,putf,w,0,left,va_arg(va, char*));
                     break;
                 case '%' :
                     putf(putp,ch);
@@ -231,4 +350,93 @@ void tfp_sprintf(char* s,char *fmt, ...)
     tfp_format(&s,putcp,fmt,va);
     putcp(&s,0);
     va_end(va);
-    }
\ No newline at end of file
+    }
+
+struct snbuf
+    {
+    char* s;
+    size_t sz;
+    size_t len;
+    };
+
+static void putcn(void* p,char c)
+    {
+    struct snbuf* b=p;
+    if (b->len+1 < b->sz)
+        b->s[b->len]=c;
+    b->len++;
+    }
+
+int tfp_vsnprintf(char* s,size_t sz,char *fmt,va_list va)
+    {
+    struct snbuf b;
+    b.s=s;
+    b.sz=sz;
+    b.len=0;
+    tfp_format(&b,putcn,fmt,va);
+    if (sz)
+        s[b.len<sz ? b.len : sz-1]=0;
+    return b.len;
+    }
+
+int tfp_snprintf(char* s,size_t sz,char *fmt, ...)
+    {
+    va_list va;
+    int n;
+    va_start(va,fmt);
+    n=tfp_vsnprintf(s,sz,fmt,va);
+    va_end(va);
+    return n;
+    }
+
+#ifdef PRINTF_BENCHMARK
+
+#include "stm32f4xx_hal.h"
+
+static uint32_t bench_cyc(void)
+    {
+    return DWT->CYCCNT;
+    }
+
+/*
+Cycles for converting a spread of values with the old and new code and
+for a few whole formatted lines. Results go out through printf.
+*/
+void tfp_benchmark(void)
+    {
+    static const uint32_t vals[8] =
+        {
+        0, 7, 42, 1234, 56789, 1000000, 87654321, 4294967295U
+        };
+    char buf[40];
+    uint32_t t0, t_old, t_new, t_s, t_f, t_ll;
+    int i;
+
+    t0=bench_cyc();
+    for (i=0;i<8;i++)
+        ui2a(vals[i],10,0,buf);
+    t_old=bench_cyc()-t0;
+
+    t0=bench_cyc();
+    for (i=0;i<8;i++)
+        u10(vals[i],&buf[sizeof(buf)-1]);
+    t_new=bench_cyc()-t0;
+
+    t0=bench_cyc();
+    tfp_snprintf(buf,sizeof(buf),"%1d:%4d %4dmV",3,2048,1650);
+    t_s=bench_cyc()-t0;
+
+    t0=bench_cyc();
+    tfp_snprintf(buf,sizeof(buf),"%.3f",-3.14159F);
+    t_f=bench_cyc()-t0;
+
+    t0=bench_cyc();
+    tfp_snprintf(buf,sizeof(buf),"%llu",18446744073709551615ULL);
+    t_ll=bench_cyc()-t0;
+
+    tfp_printf("printf: 8 values old %u cyc new %u cyc\n\r",t_old,t_new);
+    tfp_printf("printf: line %u cyc, %%.3f %u cyc, %%llu %u cyc\n\r",
+        t_s,t_f,t_ll);
+    }
+
+#endif
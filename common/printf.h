@@ -28,16 +28,21 @@ debugger at all.
 They are distributed in source form, so to use them, just compile them 
 into your project. 
 
-Two printf variants are provided: printf and sprintf. 
+Four printf variants are provided: printf, sprintf and the size-bounded
+snprintf and vsnprintf, which always terminate and return the length the
+whole output would have had.
 
-The formats supported by this implementation are: 'd' 'u' 'c' 's' 'x' 'X'.
+The formats supported by this implementation are: 'd' 'i' 'u' 'c' 's' 'x'
+'X' 'p' and 'f'.
 
-Zero padding and field width are also supported.
+Zero padding, left justify ('-'), field width and for 'f' a precision of
+0-9 (default 6) are also supported. The 'l' and 'll' length modifiers
+work on 'd' 'i' 'u' 'x' 'X'; 'll' pulls in one long divide per 9 decimal
+digits. 'f' is done in single precision on the FPU and can be dropped by
+undefining PRINTF_FLOAT_SUPPORT in printf.c.
 
-If the library is compiled with 'PRINTF_SUPPORT_LONG' defined then the 
-long specifier is also
-supported. Note that this will pull in some long math routines (pun intended!)
-and thus make your executable noticably longer.
+Defining PRINTF_BENCHMARK builds tfp_benchmark(), which measures cycles
+against the original divide-per-digit conversion.
 
 The memory foot print of course depends on the target cpu, compiler and 
 compiler options, but a rough guestimate (based on a H8S target) is about 
@@ -96,16 +101,28 @@ extern "C" {
 #endif
 
 #include <stdarg.h>
+#include <stddef.h>
+
+/* uncomment this to build tfp_benchmark() */
+//#define PRINTF_BENCHMARK
 
 void init_printf(void* putp,void (*putf) (void*,char));
 
 void tfp_printf(char *fmt, ...);
 void tfp_sprintf(char* s,char *fmt, ...);
+int tfp_snprintf(char* s,size_t sz,char *fmt, ...);
+int tfp_vsnprintf(char* s,size_t sz,char *fmt,va_list va);
 
 void tfp_format(void* putp,void (*putf) (void*,char),char *fmt, va_list va);
 
+#ifdef PRINTF_BENCHMARK
+void tfp_benchmark(void);
+#endif
+
 #define printf tfp_printf 
 #define sprintf tfp_sprintf 
+#define snprintf tfp_snprintf 
+#define vsnprintf tfp_vsnprintf 
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,102 @@
+/*
+ * prof.c - multi-region cycle profiler on the DWT cycle counter
+ */
+
+#include <string.h>
+#include "prof.h"
+#include "idle.h"
+#include "printf.h"
+
+/* probe table from the linker script */
+extern prof_probe _sprof[], _eprof[];
+
+PROF_PROBE(prof_idle, "idle");
+PROF_PROBE(prof_cal, "(cal)");
+
+uint32_t prof_overhead;
+uint32_t prof_load_cyc;
+uint64_t prof_load_idle;
+
+/*
+ * measure what an empty begin/end pair costs so the report can take it
+ * off the min, max & mean
+ */
+void prof_init(void)
+{
+	uint8_t i;
+
+	for(i=0;i<16;i++)
+	{
+		PROF_BEGIN(prof_cal);
+		PROF_END(prof_cal);
+	}
+	prof_overhead = prof_cal.min;
+	prof_reset();
+}
+
+/*
+ * clear all stats
+ */
+void prof_reset(void)
+{
+	prof_probe *p;
+
+	for(p=_sprof;p<_eprof;p++)
+	{
+		p->count = 0;
+		p->sum = 0;
+		p->min = 0xFFFFFFFF;
+		p->max = 0;
+		memset(p->hist, 0, sizeof(p->hist));
+	}
+	prof_load_cyc = DWT->CYCCNT;
+	prof_load_idle = 0;
+}
+
+/*
+ * CPU load in 0.1% since the last call - anything outside prof_idle is
+ * busy. Calls must be under 2^32 cycles (25s) apart.
+ */
+uint16_t prof_load(void)
+{
+	uint32_t now = DWT->CYCCNT, tot = now - prof_load_cyc;
+	uint64_t idle = prof_idle.sum - prof_load_idle;
+
+	prof_load_cyc = now;
+	prof_load_idle = prof_idle.sum;
+
+	if(!tot || idle >= tot)
+		return 0;
+	return 1000 - (uint16_t)(idle * 1000 / tot);
+}
+
+/*
+ * dump every probe over the console
+ */
+void prof_report(void)
+{
+	prof_probe *p;
+	uint32_t o = prof_overhead, mean;
+	uint16_t load = prof_load(), sleep = idle_sleep_pct();
+	uint8_t i;
+
+	printf("load %d.%d%%, sleep %d.%d%%, %d cycles/probe taken off\n\r",
+		load / 10, load % 10, sleep / 10, sleep % 10, o);
+	printf("probe       count      min      max     mean\n\r");
+	for(p=_sprof;p<_eprof;p++)
+	{
+		if(!p->count || (p == &prof_cal))
+			continue;
+		mean = p->sum / p->count;
+		printf("%-8s %8u %8u %8u %8u\n\r", p->name, p->count,
+			p->min > o ? p->min - o : 0, p->max > o ? p->max - o : 0,
+			mean > o ? mean - o : 0);
+
+		/* nonzero bins as log2:count */
+		printf("        ");
+		for(i=0;i<PROF_BINS;i++)
+			if(p->hist[i])
+				printf(" %d:%u", i, p->hist[i]);
+		printf("\n\r");
+	}
+}
@@ -0,0 +1,70 @@
+/*
+ * prof.h - multi-region cycle profiler on the DWT cycle counter
+ *
+ * PROF_PROBE(var, "name") defines a probe, PROF_BEGIN(var)/PROF_END(var)
+ * bracket a region. Different probes nest freely, a probe must not be
+ * re-entered while it's open. Probes are collected in the .prof section
+ * so prof_report() finds them all without registration.
+ */
+
+#ifndef __prof__
+#define __prof__
+
+#include "stm32f4xx_hal.h"
+
+/* log2 histogram - bin n counts regions of 2^n to 2^(n+1)-1 cycles */
+#define PROF_BINS 32
+
+typedef struct
+{
+	const char *name;
+	uint32_t start;
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[PROF_BINS];
+} prof_probe;
+
+/* uncomment this to compile all probes out */
+//#define PROF_DISABLE
+
+#ifndef PROF_DISABLE
+
+#define PROF_PROBE(var, str) prof_probe var \
+	__attribute__ ((section (".prof"), used, aligned(4))) = \
+	{ .name = str, .min = 0xFFFFFFFF }
+
+#define PROF_BEGIN(var) ((var).start = DWT->CYCCNT)
+#define PROF_END(var) prof_end(&(var), DWT->CYCCNT - (var).start)
+
+/* about a dozen cycles - inline so it doesn't cost a call */
+static inline void prof_end(prof_probe *p, uint32_t cyc)
+{
+	p->count++;
+	p->sum += cyc;
+	if(cyc < p->min)
+		p->min = cyc;
+	if(cyc > p->max)
+		p->max = cyc;
+	p->hist[31 - __CLZ(cyc | 1)]++;
+}
+
+#else
+
+#define PROF_PROBE(var, str) prof_probe var = { .name = str }
+#define PROF_BEGIN(var) do{}while(0)
+#define PROF_END(var) do{}while(0)
+#define prof_end(p, cyc) do{}while(0)
+
+#endif
+
+/* time spent waiting in the main loop - the rest counts as load */
+extern prof_probe prof_idle;
+
+void prof_init(void);
+void prof_reset(void);
+uint16_t prof_load(void);
+void prof_report(void);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * pt.h - stackless coroutines in the style of Dunkels' protothreads
+ *
+ * A thread is a function returning uint8_t that takes a pt_ctx first and
+ * wraps its body in PT_BEGIN/PT_END. The resume point is a switch on the
+ * line number, so locals don't survive a wait - keep state in statics or
+ * a struct, and don't use switch() across a wait. Delays are on the cycle
+ * counter & report PT_SLEEPING so a runner knows it can WFI until goal.
+ */
+
+#ifndef __pt__
+#define __pt__
+
+#include "stm32f4xx_hal.h"
+#include "cyclesleep.h"
+#include "idle.h"
+
+/* thread return codes - anything below PT_EXITED is still running */
+#define PT_WAITING  0
+#define PT_YIELDED  1
+#define PT_SLEEPING 2
+#define PT_EXITED   3
+#define PT_ENDED    4
+
+typedef struct
+{
+	uint16_t lc;
+	uint8_t state;
+	uint32_t goal;
+} pt_ctx;
+
+#define PT_INIT(pt) ((pt)->lc = 0)
+
+#define PT_BEGIN(pt) { \
+	uint8_t pt_yield_flag = 1; \
+	(void)pt_yield_flag; \
+	switch((pt)->lc) { case 0:
+
+#define PT_END(pt) } \
+	PT_INIT(pt); \
+	return PT_ENDED; }
+
+#define PT_WAIT_UNTIL(pt, cond) do { \
+	(pt)->lc = __LINE__; case __LINE__: \
+	if(!(cond)) \
+		return PT_WAITING; \
+	} while(0)
+
+#define PT_WAIT_WHILE(pt, cond) PT_WAIT_UNTIL(pt, !(cond))
+
+/* give the other threads a turn */
+#define PT_YIELD(pt) do { \
+	pt_yield_flag = 0; \
+	(pt)->lc = __LINE__; case __LINE__: \
+	if(!pt_yield_flag) \
+		return PT_YIELDED; \
+	} while(0)
+
+/* wait a number of CPU cycles or ms */
+#define PT_DELAY(pt, cycles) do { \
+	(pt)->goal = cyclegoal(cycles); \
+	(pt)->lc = __LINE__; case __LINE__: \
+	if(cyclecheck((pt)->goal)) \
+		return PT_SLEEPING; \
+	} while(0)
+
+#define PT_DELAY_MS(pt, ms) PT_DELAY(pt, (ms)*(SystemCoreClock/1000))
+
+/* give up - the caller sees PT_EXITED */
+#define PT_EXIT(pt) do { \
+	PT_INIT(pt); \
+	return PT_EXITED; \
+	} while(0)
+
+/*
+ * run a child thread to its end, passing its waits up. Afterwards
+ * (child)->state tells whether it ended or exited.
+ */
+#define PT_SPAWN(pt, child, thread) do { \
+	PT_INIT(child); \
+	(pt)->lc = __LINE__; case __LINE__: \
+	if(((child)->state = (thread)) < PT_EXITED) \
+	{ \
+		(pt)->goal = (child)->goal; \
+		return (child)->state; \
+	} \
+	} while(0)
+
+/*
+ * blocking wrapper - run a thread to its end, in WFI during its delays.
+ * (pt)->state is PT_ENDED or PT_EXITED afterwards.
+ */
+#define PT_RUN(pt, thread) do { \
+	PT_INIT(pt); \
+	while(((pt)->state = (thread)) < PT_EXITED) \
+		if((pt)->state == PT_SLEEPING) \
+			idle_sleep_until((pt)->goal, 0); \
+	} while(0)
+
+#endif
@@ -0,0 +1,238 @@
+/*
+ * rfft.c - in-place real FFT with window, dB and peak interpolation
+ *
+ * An N point real FFT is done as an N/2 point radix-2 complex FFT on the
+ * even/odd samples packed as re/im, followed by a split step. Output is
+ * packed like CMSIS arm_rfft_fast_f32: buf[0] = DC, buf[1] = Nyquist, then
+ * re/im pairs for bins 1 to N/2-1.
+ *
+ * Twiddles for the largest size and a bit-reverse table for the largest
+ * complex FFT are built once into CCM at init and decimated for smaller
+ * sizes. The Hann window is derived from the twiddle cosines.
+ */
+
+#include "rfft.h"
+#include "cyclesleep.h"
+#include "printf.h"
+
+/* cos/sin of 2*pi*k/RFFT_MAXN for k < RFFT_MAXN/2 */
+float32_t rfft_tw[RFFT_MAXN] __attribute__ ((section (".ccmram")));
+
+/* bit reversal for the RFFT_MAXN/2 point complex FFT */
+uint16_t rfft_br[RFFT_MAXN/2] __attribute__ ((section (".ccmram")));
+
+/*
+ * build tables
+ */
+void rfft_init(void)
+{
+	uint16_t i, j, k;
+
+	for(i=0;i<RFFT_MAXN/2;i++)
+	{
+		rfft_tw[2*i] = cosf(2.0F*PI*(float32_t)i/(float32_t)RFFT_MAXN);
+		rfft_tw[2*i+1] = sinf(2.0F*PI*(float32_t)i/(float32_t)RFFT_MAXN);
+
+		/* reverse RFFT_MAXLOG2-1 bits */
+		j = 0;
+		for(k=0;k<RFFT_MAXLOG2-1;k++)
+			j = (j << 1) | ((i >> k) & 1);
+		rfft_br[i] = j;
+	}
+}
+
+/*
+ * in-place radix-2 complex FFT of m points
+ */
+static void rfft_cfft(float32_t *buf, uint16_t m, uint8_t log2m)
+{
+	uint16_t i, j, len, half, step;
+	uint8_t shift = RFFT_MAXLOG2 - 1 - log2m;
+	float32_t c, s, tr, ti, *a, *b;
+
+	/* reorder */
+	for(i=0;i<m;i++)
+	{
+		j = rfft_br[i] >> shift;
+		if(i < j)
+		{
+			tr = buf[2*i];
+			ti = buf[2*i+1];
+			buf[2*i] = buf[2*j];
+			buf[2*i+1] = buf[2*j+1];
+			buf[2*j] = tr;
+			buf[2*j+1] = ti;
+		}
+	}
+
+	/* butterflies - twiddle on the outside so it's loaded once */
+	for(len=2;len<=m;len<<=1)
+	{
+		half = len >> 1;
+		step = RFFT_MAXN / len;
+		for(j=0;j<half;j++)
+		{
+			c = rfft_tw[2*j*step];
+			s = rfft_tw[2*j*step+1];
+			for(i=j;i<m;i+=len)
+			{
+				a = &buf[2*i];
+				b = &buf[2*(i+half)];
+
+				/* t = b * (c - js) */
+				tr = b[0]*c + b[1]*s;
+				ti = b[1]*c - b[0]*s;
+				b[0] = a[0] - tr;
+				b[1] = a[1] - ti;
+				a[0] += tr;
+				a[1] += ti;
+			}
+		}
+	}
+}
+
+/*
+ * in-place real FFT of n points - returns nonzero for unsupported n
+ */
+uint8_t rfft(float32_t *buf, uint16_t n)
+{
+	uint16_t m = n >> 1, k, step;
+	uint8_t log2n = 31 - __CLZ(n);
+	float32_t er, ei, orr, oi, tr, ti, c, s, *a, *b;
+
+	if((n != (1<<log2n)) || (log2n < RFFT_MINLOG2) || (log2n > RFFT_MAXLOG2))
+		return 1;
+
+	rfft_cfft(buf, m, log2n-1);
+
+	/* DC & Nyquist are both real */
+	er = buf[0];
+	buf[0] = er + buf[1];
+	buf[1] = er - buf[1];
+
+	/* split bins k & m-k */
+	step = RFFT_MAXN / n;
+	for(k=1;k<=m/2;k++)
+	{
+		a = &buf[2*k];
+		b = &buf[2*(m-k)];
+		c = rfft_tw[2*k*step];
+		s = rfft_tw[2*k*step+1];
+
+		/* even & odd parts */
+		er = 0.5F*(a[0] + b[0]);
+		ei = 0.5F*(a[1] - b[1]);
+		orr = 0.5F*(a[0] - b[0]);
+		oi = 0.5F*(a[1] + b[1]);
+
+		/* t = (c - js) * o */
+		tr = c*orr + s*oi;
+		ti = c*oi - s*orr;
+
+		a[0] = er + ti;
+		a[1] = ei - tr;
+		b[0] = er - ti;
+		b[1] = -ei - tr;
+	}
+
+	return 0;
+}
+
+/*
+ * apply a Hann window in place
+ */
+void rfft_window(float32_t *buf, uint16_t n)
+{
+	uint16_t i, step = RFFT_MAXN / n, m = n >> 1;
+	float32_t c;
+
+	/* cos(2pi(i+n/2)/n) = -cos(2pi*i/n) covers the second half */
+	for(i=0;i<m;i++)
+	{
+		c = 0.5F*rfft_tw[2*i*step];
+		buf[i] *= 0.5F - c;
+		buf[i+m] *= 0.5F + c;
+	}
+}
+
+/*
+ * fast log2 - exponent plus a quadratic on the mantissa, ~0.02 dB error
+ */
+static float32_t rfft_log2(float32_t x)
+{
+	union { float32_t f; uint32_t i; } u = { x };
+	float32_t e, m;
+
+	e = (float32_t)((int32_t)((u.i >> 23) & 0xff) - 128);
+	u.i = (u.i & 0x007fffff) | 0x3f800000;
+	m = u.f;
+
+	return e + (-0.34484843F*m + 2.02466578F)*m - 0.67487759F;
+}
+
+/*
+ * magnitude in dB relative to ref for bins 0 to n/2-1 - db may alias buf
+ */
+void rfft_db(float32_t *buf, float32_t *db, uint16_t n, float32_t ref)
+{
+	uint16_t k;
+	float32_t p, offs;
+
+	/* 10*log10(2) = 3.0103 */
+	offs = 2.0F*3.0103F*rfft_log2(ref);
+	db[0] = 3.0103F*rfft_log2(buf[0]*buf[0] + 1e-20F) - offs;
+	for(k=1;k<n/2;k++)
+	{
+		p = buf[2*k]*buf[2*k] + buf[2*k+1]*buf[2*k+1];
+		db[k] = 3.0103F*rfft_log2(p + 1e-20F) - offs;
+	}
+}
+
+/*
+ * find the largest bin above DC and refine it with a parabolic fit
+ * returns the fractional bin, level in dB goes to *level
+ */
+float32_t rfft_peak(float32_t *db, uint16_t nbins, float32_t *level)
+{
+	uint16_t k, pk = 1;
+	float32_t a, b, c, d, den;
+
+	for(k=2;k<nbins-1;k++)
+		if(db[k] > db[pk])
+			pk = k;
+
+	a = db[pk-1];
+	b = db[pk];
+	c = db[pk+1];
+	den = a - 2.0F*b + c;
+	d = (den < 0.0F) ? 0.5F*(a - c)/den : 0.0F;
+	*level = b - 0.25F*(a - c)*d;
+
+	return (float32_t)pk + d;
+}
+
+/*
+ * cycle counts for each supported size on a test tone - builds the
+ * tables itself since it may run before any user of rfft is set up
+ */
+void rfft_benchmark(void)
+{
+	static float32_t buf[RFFT_MAXN] __attribute__ ((section (".ccmram")));
+	uint16_t n, i;
+	uint32_t act, tot;
+
+	rfft_init();
+
+	for(n=1<<RFFT_MINLOG2;n<=RFFT_MAXN;n<<=1)
+	{
+		for(i=0;i<n;i++)
+			buf[i] = sinf(2.0F*PI*10.25F*(float32_t)i/(float32_t)n);
+
+		start_meas();
+		rfft(buf, n);
+		end_meas();
+		get_meas(&act, &tot);
+
+		printf("rfft %4d: %7d cycles\n\r", n, act);
+	}
+}
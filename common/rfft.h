@@ -0,0 +1,22 @@
+/*
+ * rfft.h - in-place real FFT with window, dB and peak interpolation
+ */
+
+#ifndef __rfft__
+#define __rfft__
+
+#include "arm_math.h"
+
+/* supported sizes are 2^RFFT_MINLOG2 to 2^RFFT_MAXLOG2 points */
+#define RFFT_MINLOG2 6
+#define RFFT_MAXLOG2 12
+#define RFFT_MAXN (1<<RFFT_MAXLOG2)
+
+void rfft_init(void);
+uint8_t rfft(float32_t *buf, uint16_t n);
+void rfft_window(float32_t *buf, uint16_t n);
+void rfft_db(float32_t *buf, float32_t *db, uint16_t n, float32_t ref);
+float32_t rfft_peak(float32_t *db, uint16_t nbins, float32_t *level);
+void rfft_benchmark(void);
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * sched.c - deadline-driven run-to-completion task scheduler
+ *
+ * Tasks are released by their period, by events posted from IRQs with
+ * idle_post(), or both. The ready task with the lowest prio number runs
+ * next, earliest deadline first within a priority, and always runs to
+ * completion. With nothing ready the core sleeps in WFI until the next
+ * release or event.
+ *
+ * Overruns are counted two ways - a miss is a run that finished later
+ * than its deadline after release, a skip is a release that came while
+ * the previous one still hadn't run. All times are in CPU cycles.
+ */
+
+#include "sched.h"
+#include "cyclesleep.h"
+#include "idle.h"
+#include "prof.h"
+#include "printf.h"
+
+sched_task sched_tasks[SCHED_MAXTASKS];
+uint8_t sched_num;
+uint32_t sched_t_reset;
+
+/*
+ * add a task - period 0 is event-only. Deadline defaults to the period.
+ * Returns the id or -1 if the table is full.
+ */
+int8_t sched_add(const char *name, sched_fn fn, uint32_t period_ms,
+	uint8_t prio, uint32_t events)
+{
+	sched_task *t;
+
+	if(sched_num >= SCHED_MAXTASKS)
+		return -1;
+
+	t = &sched_tasks[sched_num];
+	t->name = name;
+	t->fn = fn;
+	t->period = period_ms * (SystemCoreClock / 1000);
+	t->deadline = t->period;
+	t->events = events;
+	t->prio = prio;
+	t->ready = 0;
+
+	return sched_num++;
+}
+
+/*
+ * deadline from release in ms - 0 turns the miss check off
+ */
+void sched_set_deadline(int8_t id, uint32_t ms)
+{
+	if((id >= 0) && (id < sched_num))
+		sched_tasks[id].deadline = ms * (SystemCoreClock / 1000);
+}
+
+/*
+ * mark released tasks ready & pick the one to run
+ */
+static sched_task *sched_pick(uint32_t ev, uint32_t now)
+{
+	sched_task *t, *best = NULL;
+
+	for(t=sched_tasks;t<&sched_tasks[sched_num];t++)
+	{
+		if(ev & t->events)
+		{
+			if(!t->ready)
+			{
+				t->ready = 1;
+				t->release = now;
+			}
+		}
+
+		if(t->period && !cyclecheck(t->next))
+		{
+			if(t->ready)
+				t->skips++;
+			else
+			{
+				t->ready = 1;
+				t->release = t->next;
+			}
+
+			/* more than a period behind - drop the lost releases */
+			t->next += t->period;
+			if(!cyclecheck(t->next))
+			{
+				t->skips++;
+				t->next = now + t->period;
+			}
+		}
+
+		if(!t->ready)
+			continue;
+		if(!best || (t->prio < best->prio) || ((t->prio == best->prio) &&
+			((int32_t)((t->release + t->deadline) -
+			(best->release + best->deadline)) < 0)))
+			best = t;
+	}
+
+	return best;
+}
+
+/*
+ * earliest periodic release - a second out if there are none
+ */
+static uint32_t sched_wake(uint32_t now)
+{
+	sched_task *t;
+	uint32_t wake = now + SystemCoreClock;
+
+	for(t=sched_tasks;t<&sched_tasks[sched_num];t++)
+		if(t->period && ((int32_t)(t->next - wake) < 0))
+			wake = t->next;
+
+	return wake;
+}
+
+/*
+ * run the tasks forever
+ */
+void sched_run(void)
+{
+	sched_task *t;
+	uint32_t evmask = 0, ev = 0, now, start, cyc;
+
+	now = DWT->CYCCNT;
+	for(t=sched_tasks;t<&sched_tasks[sched_num];t++)
+	{
+		evmask |= t->events;
+		t->next = now;
+	}
+	sched_reset();
+
+	while(1)
+	{
+		ev |= idle_take(evmask);
+		now = DWT->CYCCNT;
+		t = sched_pick(ev, now);
+		ev = 0;
+
+		if(!t)
+		{
+			PROF_BEGIN(prof_idle);
+			ev = idle_sleep_until(sched_wake(now), evmask);
+			PROF_END(prof_idle);
+			continue;
+		}
+
+		t->ready = 0;
+		start = DWT->CYCCNT;
+		t->fn();
+		now = DWT->CYCCNT;
+
+		cyc = now - start;
+		t->runs++;
+		t->total += cyc;
+		if(cyc > t->wcet)
+			t->wcet = cyc;
+		if(start - t->release > t->maxlat)
+			t->maxlat = start - t->release;
+		if(t->deadline && (now - t->release > t->deadline))
+			t->misses++;
+	}
+}
+
+void sched_reset(void)
+{
+	sched_task *t;
+
+	for(t=sched_tasks;t<&sched_tasks[sched_num];t++)
+	{
+		t->runs = 0;
+		t->total = 0;
+		t->wcet = 0;
+		t->maxlat = 0;
+		t->misses = 0;
+		t->skips = 0;
+	}
+	sched_t_reset = HAL_GetTick();
+}
+
+/*
+ * per-task stats since the last reset - load in 0.01%
+ */
+void sched_report(void)
+{
+	sched_task *t;
+	uint32_t ms = HAL_GetTick() - sched_t_reset, load;
+
+	if(!ms)
+		ms = 1;
+	printf("task     pri  per   runs  load%%     wcet   maxlat  miss  skip\n\r");
+	for(t=sched_tasks;t<&sched_tasks[sched_num];t++)
+	{
+		load = t->total * 10000 / ((uint64_t)ms * (SystemCoreClock / 1000));
+		printf("%-8s %3d %4u %6u %3u.%02u %8u %8u %5u %5u\n\r", t->name,
+			t->prio, t->period / (SystemCoreClock / 1000), t->runs,
+			load / 100, load % 100, t->wcet, t->maxlat, t->misses, t->skips);
+	}
+}
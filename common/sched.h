@@ -0,0 +1,40 @@
+/*
+ * sched.h - deadline-driven run-to-completion task scheduler
+ */
+
+#ifndef __sched__
+#define __sched__
+
+#include "stm32f4xx_hal.h"
+
+#define SCHED_MAXTASKS 12
+
+typedef void (*sched_fn)(void);
+
+typedef struct
+{
+	const char *name;
+	sched_fn fn;
+	uint32_t period;
+	uint32_t deadline;
+	uint32_t events;
+	uint8_t prio;
+	uint8_t ready;
+	uint32_t next;
+	uint32_t release;
+	uint32_t runs;
+	uint64_t total;
+	uint32_t wcet;
+	uint32_t maxlat;
+	uint32_t misses;
+	uint32_t skips;
+} sched_task;
+
+int8_t sched_add(const char *name, sched_fn fn, uint32_t period_ms,
+	uint8_t prio, uint32_t events);
+void sched_set_deadline(int8_t id, uint32_t ms);
+void sched_run(void);
+void sched_reset(void);
+void sched_report(void);
+
+#endif
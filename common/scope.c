@@ -0,0 +1,341 @@
+/*
+ * scope.c - oscilloscope view on the TFT Wing
+ *
+ * Runs in the 160x80 landscape view from ST7735_setRotation(3). Each frame
+ * is one triggered capture rendered as a column of min/max spans joined to
+ * the previous column so fast edges stay connected. Only columns whose span
+ * changed are sent, and each is a single window covering the union of the
+ * old and new spans so the previous trace is erased in the same transfer.
+ *
+ * Buttons: left/right timebase, up/down volts/div, A/B trigger level,
+ * select run/hold.
+ */
+
+#include "scope.h"
+#include "adc_capture.h"
+#include "st7735.h"
+#include "tftwing.h"
+#include "cyclesleep.h"
+#include "printf.h"
+
+/* screen geometry */
+#define SCOPE_W 160
+#define SCOPE_TOP 8
+#define SCOPE_H 72
+#define SCOPE_XDIV 20
+#define SCOPE_YDIV 18
+#define SCOPE_NONE 0xFF
+
+/* colors */
+#define SCOPE_BG ST7735_BLACK
+#define SCOPE_GRID 0x4208
+#define SCOPE_TRACE ST7735_YELLOW
+#define SCOPE_TEXT ST7735_GREEN
+
+/* auto trigger timeout and button poll interval */
+#define SCOPE_AUTO_MS 50
+#define SCOPE_BTN_FRAMES 4
+
+/* timebases - ADC sample time code and samples per column */
+const uint8_t scope_tb[][2] =
+{
+	{ADC_SAMPLETIME_3CYCLES, 1},
+	{ADC_SAMPLETIME_3CYCLES, 2},
+	{ADC_SAMPLETIME_3CYCLES, 4},
+	{ADC_SAMPLETIME_3CYCLES, 8},
+	{ADC_SAMPLETIME_3CYCLES, 16},
+	{ADC_SAMPLETIME_56CYCLES, 8},
+	{ADC_SAMPLETIME_144CYCLES, 8},
+	{ADC_SAMPLETIME_480CYCLES, 4},
+	{ADC_SAMPLETIME_480CYCLES, 8},
+	{ADC_SAMPLETIME_480CYCLES, 16},
+};
+#define SCOPE_NUMTB (sizeof(scope_tb)/sizeof(scope_tb[0]))
+
+/* vertical scales as log2 of counts per division */
+const uint8_t scope_vdiv[] = {10, 9, 8, 7, 6};
+#define SCOPE_NUMVDIV (sizeof(scope_vdiv)/sizeof(scope_vdiv[0]))
+
+/* state */
+uint8_t scope_chl, scope_tbidx, scope_vidx, scope_run, scope_frames;
+uint16_t scope_level, scope_fps, scope_fcnt;
+uint32_t scope_btns, scope_auto_goal, scope_fps_goal;
+uint16_t scope_data[240*16];
+uint8_t scope_old_lo[SCOPE_W], scope_old_hi[SCOPE_W];
+uint16_t scope_col[SCOPE_H];
+
+/*
+ * background color at a screen location - dotted graticule
+ */
+static uint16_t scope_bg(uint8_t x, uint8_t y)
+{
+	y -= SCOPE_TOP;
+	if(((x % SCOPE_XDIV) == 0) && ((y & 1) == 0))
+		return SCOPE_GRID;
+	if(((y % SCOPE_YDIV) == 0) && ((x & 3) == 0))
+		return SCOPE_GRID;
+	return SCOPE_BG;
+}
+
+/*
+ * send one column covering old & new spans
+ */
+static void scope_col_draw(uint8_t x, uint8_t lo, uint8_t hi)
+{
+	uint8_t olo = scope_old_lo[x], ohi = scope_old_hi[x], y0, y1, y;
+	uint16_t *p = scope_col;
+
+	/* union of what was there and what will be */
+	y0 = lo;
+	y1 = hi;
+	if(olo != SCOPE_NONE)
+	{
+		if(olo < y0)
+			y0 = olo;
+		if(ohi > y1)
+			y1 = ohi;
+	}
+
+	/* build the column - colors are byte swapped for bitblt */
+	for(y=y0;y<=y1;y++)
+	{
+		if((y >= lo) && (y <= hi))
+			*p++ = __REVSH(SCOPE_TRACE);
+		else
+			*p++ = __REVSH(scope_bg(x, y));
+	}
+	ST7735_bitblt(x, y0, 1, y1-y0+1, scope_col);
+
+	scope_old_lo[x] = lo;
+	scope_old_hi[x] = hi;
+}
+
+/*
+ * sample value to screen row
+ */
+static uint8_t scope_y(uint16_t val)
+{
+	int32_t y = ((int32_t)val - 2048) * SCOPE_YDIV;
+
+	y = SCOPE_TOP + SCOPE_H/2 - (y >> scope_vdiv[scope_vidx]);
+	if(y < SCOPE_TOP)
+		y = SCOPE_TOP;
+	else if(y > SCOPE_TOP + SCOPE_H - 1)
+		y = SCOPE_TOP + SCOPE_H - 1;
+
+	return y;
+}
+
+/*
+ * status line - timebase, volts/div & trigger level
+ */
+static void scope_status(void)
+{
+	char txtbuf[24], tb[12];
+	uint32_t us, mv;
+
+	/* 20 columns per div, 3.3V full scale */
+	us = (uint32_t)SCOPE_XDIV * scope_tb[scope_tbidx][1] * 1000000 /
+		ADC_CapGetRate();
+	mv = (3300 << scope_vdiv[scope_vidx]) >> 12;
+
+	/* timebase text isn't always 5 wide so the line is built in one go */
+	if(us < 1000)
+		snprintf(tb, sizeof(tb), "%3dus", us);
+	else
+		snprintf(tb, sizeof(tb), "%2d.%1dm", us/1000, (us%1000)/100);
+	snprintf(txtbuf, sizeof(txtbuf), "%s %4dmV T%4d%c", tb, mv, scope_level,
+		scope_run ? ' ' : 'H');
+	ST7735_drawstr(0, 0, txtbuf, SCOPE_TEXT, ST7735_BLACK);
+}
+
+/*
+ * arm a new capture centered on the trigger with slack for the search
+ */
+static void scope_arm(void)
+{
+	uint16_t d = scope_tb[scope_tbidx][1];
+
+	ADC_CapStart(scope_chl, scope_tb[scope_tbidx][0], 120*d, 120*d,
+		ADC_CAP_TRIG_AWD, 0, scope_level, NULL);
+	scope_auto_goal = cyclegoal_ms(SCOPE_AUTO_MS);
+}
+
+/*
+ * render a finished capture
+ */
+static void scope_render(void)
+{
+	uint16_t d = scope_tb[scope_tbidx][1], n, start, k, v, vmin, vmax;
+	uint8_t x, lo, hi, last;
+	uint16_t *p;
+
+	n = ADC_CapRead(scope_data, 240*d);
+	if(n < 240*d)
+		return;
+
+	/* find the rising edge nearest after the nominal trigger */
+	start = 40*d;
+	for(k=80*d;k<160*d;k++)
+	{
+		if((scope_data[k-1] < scope_level) && (scope_data[k] >= scope_level))
+		{
+			start = k - 80*d;
+			break;
+		}
+	}
+
+	/* min/max per column joined to the previous column */
+	p = &scope_data[start];
+	last = scope_y(*p);
+	for(x=0;x<SCOPE_W;x++)
+	{
+		vmin = vmax = *p;
+		for(k=0;k<d;k++)
+		{
+			v = *p++;
+			if(v < vmin)
+				vmin = v;
+			if(v > vmax)
+				vmax = v;
+		}
+		lo = scope_y(vmax);
+		hi = scope_y(vmin);
+		if(last < lo)
+			lo = last;
+		if(last > hi)
+			hi = last;
+		last = scope_y(p[-1]);
+
+		if((lo != scope_old_lo[x]) || (hi != scope_old_hi[x]))
+			scope_col_draw(x, lo, hi);
+	}
+}
+
+/*
+ * redraw the whole graticule
+ */
+static void scope_clear(void)
+{
+	uint8_t x;
+
+	for(x=0;x<SCOPE_W;x++)
+	{
+		scope_old_lo[x] = SCOPE_TOP;
+		scope_old_hi[x] = SCOPE_TOP + SCOPE_H - 1;
+		scope_col_draw(x, SCOPE_TOP + SCOPE_H/2, SCOPE_TOP + SCOPE_H/2);
+	}
+}
+
+/*
+ * handle button presses - buttons read low when pressed
+ */
+static void scope_buttons(void)
+{
+	uint32_t btns = ~tftwing_readButtons() & TFTWING_BUTTON_ALL;
+	uint32_t press = btns & ~scope_btns;
+	uint16_t step = (1 << scope_vdiv[scope_vidx]) >> 2;
+	uint8_t rearm = 0;
+
+	scope_btns = btns;
+	if(!press)
+		return;
+
+	if((press & TFTWING_BUTTON_RIGHT) && (scope_tbidx < SCOPE_NUMTB-1))
+	{
+		scope_tbidx++;
+		rearm = 1;
+	}
+	if((press & TFTWING_BUTTON_LEFT) && (scope_tbidx > 0))
+	{
+		scope_tbidx--;
+		rearm = 1;
+	}
+	if((press & TFTWING_BUTTON_UP) && (scope_vidx < SCOPE_NUMVDIV-1))
+		scope_vidx++;
+	if((press & TFTWING_BUTTON_DOWN) && (scope_vidx > 0))
+		scope_vidx--;
+	if((press & TFTWING_BUTTON_A) && (scope_level < 4095 - step))
+	{
+		scope_level += step;
+		rearm = 1;
+	}
+	if((press & TFTWING_BUTTON_B) && (scope_level > step))
+	{
+		scope_level -= step;
+		rearm = 1;
+	}
+	if(press & TFTWING_BUTTON_SELECT)
+		scope_run = !scope_run;
+
+	if(rearm)
+		scope_arm();
+	scope_status();
+}
+
+/*
+ * start the scope on an ADC channel
+ */
+void scope_init(uint8_t chl)
+{
+	scope_chl = chl;
+	scope_tbidx = 2;
+	scope_vidx = 0;
+	scope_level = 2048;
+	scope_run = 1;
+	scope_frames = 0;
+	scope_btns = 0;
+	scope_fps = scope_fcnt = 0;
+	scope_fps_goal = cyclegoal_ms(1000);
+
+	ST7735_fillScreen(ST7735_BLACK);
+	scope_clear();
+	scope_arm();
+	scope_status();
+}
+
+/*
+ * call from the main loop - never blocks on the capture
+ */
+void scope_update(void)
+{
+	uint8_t state = ADC_CapState();
+
+	/* frame rate */
+	if(!cyclecheck(scope_fps_goal))
+	{
+		scope_fps = scope_fcnt;
+		scope_fcnt = 0;
+		scope_fps_goal = cyclegoal_ms(1000);
+	}
+
+	/* auto trigger when no edge shows up */
+	if((state == ADC_CAP_ARMED) && !cyclecheck(scope_auto_goal))
+		ADC_CapTrigger();
+
+	if(state != ADC_CAP_DONE)
+		return;
+
+	if(scope_run)
+	{
+		scope_render();
+		scope_fcnt++;
+	}
+
+	/* I2C button reads are slow so don't do them every frame */
+	if(++scope_frames >= SCOPE_BTN_FRAMES)
+	{
+		scope_frames = 0;
+		scope_buttons();
+	}
+
+	scope_arm();
+}
+
+/*
+ * frames per second over the last second
+ */
+uint16_t scope_get_fps(void)
+{
+	return scope_fps;
+}
@@ -0,0 +1,14 @@
+/*
+ * scope.h - oscilloscope view on the TFT Wing
+ */
+
+#ifndef __scope__
+#define __scope__
+
+#include "stm32f4xx_hal.h"
+
+void scope_init(uint8_t chl);
+void scope_update(void);
+uint16_t scope_get_fps(void);
+
+#endif
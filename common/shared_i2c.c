@@ -4,8 +4,10 @@
  */
 
 #include "shared_i2c.h"
+#include "prof.h"
 
 I2C_HandleTypeDef hi2c1;
+shared_i2c_stats i2c_st;
 
 /*
  * initialize shared I2C bus
@@ -55,4 +57,59 @@ void shared_i2c_reset(void)
 
 	/* Init the I2C */
 	HAL_I2C_Init(&hi2c1);
+	i2c_st.resets++;
+}
+
+/* time in blocking transfers */
+PROF_PROBE(prof_i2c, "i2c");
+
+/*
+ * count a finished transfer
+ */
+static HAL_StatusTypeDef shared_i2c_count(HAL_StatusTypeDef status,
+	uint16_t sz, uint32_t start)
+{
+	uint32_t cyc = DWT->CYCCNT - start;
+
+	prof_end(&prof_i2c, cyc);
+	i2c_st.xfers++;
+	i2c_st.cycles += cyc;
+	if(status == HAL_OK)
+		i2c_st.bytes += sz;
+	else
+		i2c_st.errors++;
+
+	return status;
+}
+
+/*
+ * blocking master write
+ */
+HAL_StatusTypeDef shared_i2c_write(uint16_t addr, uint8_t *buf, uint16_t sz,
+	uint32_t timeout)
+{
+	uint32_t start = DWT->CYCCNT;
+
+	return shared_i2c_count(HAL_I2C_Master_Transmit(&hi2c1, addr, buf, sz,
+		timeout), sz, start);
+}
+
+/*
+ * blocking master read
+ */
+HAL_StatusTypeDef shared_i2c_read(uint16_t addr, uint8_t *buf, uint16_t sz,
+	uint32_t timeout)
+{
+	uint32_t start = DWT->CYCCNT;
+
+	return shared_i2c_count(HAL_I2C_Master_Receive(&hi2c1, addr, buf, sz,
+		timeout), sz, start);
+}
+
+/*
+ * get a copy of the counters
+ */
+void shared_i2c_get_stats(shared_i2c_stats *st)
+{
+	*st = i2c_st;
 }
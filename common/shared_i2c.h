@@ -14,8 +14,23 @@ extern "C" {
 
 extern I2C_HandleTypeDef hi2c1;
 
+/* bus counters */
+typedef struct
+{
+	uint32_t xfers;         /* transfers attempted */
+	uint32_t bytes;         /* bytes moved by successful transfers */
+	uint32_t errors;        /* failed transfers */
+	uint32_t resets;        /* bus resets */
+	uint32_t cycles;        /* CPU cycles spent waiting on the bus */
+} shared_i2c_stats;
+
 void shared_i2c_init(void);
 void shared_i2c_reset(void);
+HAL_StatusTypeDef shared_i2c_write(uint16_t addr, uint8_t *buf, uint16_t sz,
+	uint32_t timeout);
+HAL_StatusTypeDef shared_i2c_read(uint16_t addr, uint8_t *buf, uint16_t sz,
+	uint32_t timeout);
+void shared_i2c_get_stats(shared_i2c_stats *st);
 
 #ifdef __cplusplus
 }
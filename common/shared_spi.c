@@ -6,6 +6,7 @@
  */
 
 #include "shared_spi.h"
+#include "prof.h"
 
 #define SPI_MOSI_GPIO_CLK_ENABLE() __HAL_RCC_GPIOB_CLK_ENABLE()
 #define SPI_MOSI_GPIO_PORT GPIOB
@@ -40,12 +41,21 @@ DMA_HandleTypeDef hdma_spi = {0};
 /* SPI port handle */
 SPI_HandleTypeDef SpiHandle;
 
+/* counters */
+shared_spi_stats spi_st;
+#define SPI_COUNT(n) do{spi_st.xfers++; spi_st.bytes += (n);}while(0)
+
+/* time in the blocking block writes */
+PROF_PROBE(prof_spi, "spi");
+
 /* ----------------------- Private functions ----------------------- */
 /*
  * Read byte from SPI interface
  */
 uint8_t Shared_SPI_ReadByte(void)
 {
+	SPI_COUNT(1);
+
 	/* Wait until the transmit buffer is empty */
 	while(__HAL_SPI_GET_FLAG(&SpiHandle, SPI_FLAG_TXE) == RESET)
 	{
@@ -70,6 +80,8 @@ void Shared_SPI_WriteByte(uint8_t Data)
 {
     uint8_t dummy __attribute__ ((unused));
 
+	SPI_COUNT(1);
+
 	/* Wait until the transmit buffer is empty */
 	while(__HAL_SPI_GET_FLAG(&SpiHandle, SPI_FLAG_TXE) == RESET)
 	{
@@ -103,6 +115,8 @@ void Shared_SPI_WriteBytes(uint8_t *pData, uint16_t size)
  */
 void Shared_SPI_WriteWord(uint16_t Data)
 {
+	SPI_COUNT(2);
+
 	/* Wait until the transmit buffer is empty */
 	while(__HAL_SPI_GET_FLAG(&SpiHandle, SPI_FLAG_TXE) == RESET);
 
@@ -145,6 +159,9 @@ void Shared_SPI_WriteWord(uint16_t Data)
   */
 void Shared_SPI_Blocking_PIO_WriteBytes(uint8_t *pData, uint32_t Size)
 {
+	SPI_COUNT(Size);
+	PROF_BEGIN(prof_spi);
+
 	/* send it in 8 mode */
 	while(Size > 0)
 	{
@@ -169,6 +186,7 @@ void Shared_SPI_Blocking_PIO_WriteBytes(uint8_t *pData, uint32_t Size)
 
 	/* Clear OVERUN flag because received is not read */
 	__HAL_SPI_CLEAR_OVRFLAG(&SpiHandle);
+	PROF_END(prof_spi);
 }
 
 /**
@@ -181,6 +199,9 @@ void Shared_SPI_Blocking_PIO_WriteBytes(uint8_t *pData, uint32_t Size)
   */
 void Shared_SPI_Blocking_PIO_WriteWord(uint16_t Data, uint32_t Size)
 {
+	SPI_COUNT(2*Size);
+	PROF_BEGIN(prof_spi);
+
 	/* send it in 16 and 8 modes for speed */
 	while (Size > 0)
 	{
@@ -207,6 +228,7 @@ void Shared_SPI_Blocking_PIO_WriteWord(uint16_t Data, uint32_t Size)
 
 	/* Clear OVERUN flag because received is not read */
 	__HAL_SPI_CLEAR_OVRFLAG(&SpiHandle);
+	PROF_END(prof_spi);
 }
 
 #ifdef SHARED_SPI_USE_DMA
@@ -239,6 +261,8 @@ void Shared_SPI_InitDMA(void)
  */
 void Shared_SPI_start_DMA_WriteBytes(uint8_t *buffer, int32_t count)
 {
+	SPI_COUNT(count);
+
     /* Setup buffer loc / len */
     hdma_spi.Instance->CNDTR = (uint32_t)count;
     hdma_spi.Instance->CMAR = (uint32_t)buffer;
@@ -352,3 +376,11 @@ void Shared_SPI_Init(void)
 	/* Enable SPI */
     __HAL_SPI_ENABLE(&SpiHandle);
 }
+
+/*
+ * get a copy of the counters
+ */
+void Shared_SPI_GetStats(shared_spi_stats *st)
+{
+	*st = spi_st;
+}
@@ -15,6 +15,13 @@ extern "C" {
 
 #include "stm32f4xx_hal.h"
 
+/* port counters */
+typedef struct
+{
+	uint32_t xfers;         /* calls that moved data */
+	uint32_t bytes;         /* bytes on the wire */
+} shared_spi_stats;
+
 uint8_t Shared_SPI_ReadByte(void);
 void Shared_SPI_WriteByte(uint8_t Data);
 void Shared_SPI_WriteBytes(uint8_t *pData, uint16_t size);
@@ -24,6 +31,7 @@ void Shared_SPI_Blocking_PIO_WriteWord(uint16_t Data, uint32_t Size);
 void Shared_SPI_start_DMA_WriteBytes(uint8_t *buffer, int32_t count);
 void Shared_SPI_end_DMA_WriteBytes(void);
 void Shared_SPI_Init(void);
+void Shared_SPI_GetStats(shared_spi_stats *st);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,445 @@
+/*
+ * shell.c - command shell on the diagnostic console
+ *
+ * shell_poll() drains the USART (or USB) RX ring from the main loop into
+ * a line editor and runs whole lines, so nothing here executes in an ISR.
+ * Modules add their own commands with shell_register().
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "shell.h"
+#include "usart.h"
+#include "printf.h"
+#include "adc.h"
+#include "adc_cal.h"
+#include "shared_i2c.h"
+#include "shared_spi.h"
+#include "cyclesleep.h"
+#include "usb_cdc.h"
+#include "prof.h"
+#include "pcsamp.h"
+#include "irqstat.h"
+#include "sched.h"
+#include "bootseq.h"
+
+typedef struct
+{
+	const char *name;
+	const char *help;
+	shell_fn fn;
+} shell_cmd;
+
+shell_cmd shell_cmds[SHELL_MAXCMDS];
+uint8_t shell_numcmds;
+char shell_line[SHELL_LINELEN];
+uint8_t shell_len, shell_lastcr;
+shell_rd shell_input = usart_read;
+
+/*
+ * parse a decimal or 0x hex number - sets *err if it isn't one
+ */
+uint32_t shell_num(const char *s, uint8_t *err)
+{
+	char *end;
+	uint32_t val = strtoul(s, &end, 0);
+
+	if((end == s) || *end)
+		*err = 1;
+
+	return val;
+}
+
+/*
+ * list commands
+ */
+static void shell_help(int argc, char **argv)
+{
+	uint8_t i;
+
+	for(i=0;i<shell_numcmds;i++)
+		printf("%-8s %s\n\r", shell_cmds[i].name, shell_cmds[i].help);
+}
+
+/*
+ * ADC snapshot, or change the scan mode / rate
+ */
+static void shell_adc(int argc, char **argv)
+{
+	ADC_Snapshot snap;
+	uint8_t i, err = 0;
+	uint32_t val;
+
+	if(argc == 3)
+	{
+		val = shell_num(argv[2], &err);
+		if(err)
+			printf("bad number\n\r");
+		else if(!strcmp(argv[1], "mode"))
+		{
+			/* ADC_SetMode takes a uint8_t - don't let 256 become 0 */
+			if(val > 0xFF)
+				printf("mode %d rejected\n\r", val);
+			else
+				printf("mode %d: %d\n\r", val, ADC_SetMode(val));
+		}
+		else if(!strcmp(argv[1], "rate"))
+		{
+			if(ADC_ChangeRate(val))
+				printf("rate %d rejected\n\r", val);
+			else
+				printf("rate %d\n\r", ADC_GetRate());
+		}
+		else
+			printf("usage: adc [mode n | rate hz]\n\r");
+		return;
+	}
+
+	ADC_GetSnapshot(&snap);
+	printf("seq %u @ %llu us, %d Hz, VDDA %d mV\n\r", snap.seq,
+		cyc_to_us(snap.cycles),
+		ADC_GetRate(), ADC_CAL_MV(ADC_CalGetVdda()));
+	for(i=0;i<snap.num;i++)
+		printf("%2d: in%2d %4d %4d mV %5d Hz %2d bits\n\r", i,
+			ADC_GetChlInput(i), snap.chl[i], ADC_CAL_MV(ADC_CalGetMv(i)),
+			ADC_GetChlRate(i), ADC_GetChlBits(i));
+	printf("bat %d mV %d%%\n\r", ADC_CalGetBattMv(), ADC_CalGetSoc());
+}
+
+/*
+ * I2C bus counters
+ */
+static void shell_i2c(int argc, char **argv)
+{
+	shared_i2c_stats st;
+
+	shared_i2c_get_stats(&st);
+	printf("xfers %u bytes %u errors %u resets %u cycles %u\n\r",
+		st.xfers, st.bytes, st.errors, st.resets, st.cycles);
+}
+
+/*
+ * SPI port counters
+ */
+static void shell_spi(int argc, char **argv)
+{
+	shared_spi_stats st;
+
+	Shared_SPI_GetStats(&st);
+	printf("xfers %u bytes %u\n\r", st.xfers, st.bytes);
+}
+
+/*
+ * USART counters
+ */
+static void shell_uart(int argc, char **argv)
+{
+	usart_stats st;
+
+	usart_get_stats(&st);
+	printf("tx queued %u sent %u dropped %u overwritten %u peak %u\n\r",
+		st.queued, st.sent, st.dropped, st.overwritten, st.peak);
+	printf("rx read %u lost %u errors %u\n\r", st.received, st.rx_lost,
+		st.rx_errors);
+}
+
+/*
+ * USB port counters or a throughput test
+ */
+static void shell_usb(int argc, char **argv)
+{
+	usb_cdc_stats st;
+	uint8_t err = 0;
+	uint32_t bytes;
+
+	if((argc == 3) && !strcmp(argv[1], "test"))
+	{
+		bytes = shell_num(argv[2], &err);
+		if(err || !usb_cdc_ready())
+		{
+			printf("usage: usb test bytes - with the USB port open\n\r");
+			return;
+		}
+		/* tools/cdcbench syncs on this line */
+		printf("usb test start\n\r");
+		usb_cdc_test(bytes);
+		return;
+	}
+
+	usb_cdc_get_stats(&st);
+	printf("%s%s resets %u\n\r", st.configured ? "configured" : "detached",
+		st.dtr ? " open" : "", st.resets);
+	printf("tx queued %u sent %u dropped %u rx read %u\n\r", st.queued,
+		st.sent, st.dropped, st.received);
+}
+
+/*
+ * profiler report
+ */
+static void shell_prof(int argc, char **argv)
+{
+	if((argc == 2) && !strcmp(argv[1], "reset"))
+		prof_reset();
+	else
+		prof_report();
+}
+
+static void shell_sched(int argc, char **argv)
+{
+	if((argc == 2) && !strcmp(argv[1], "reset"))
+		sched_reset();
+	else
+		sched_report();
+}
+
+static void shell_boot(int argc, char **argv)
+{
+	boot_report();
+}
+
+static void shell_irq(int argc, char **argv)
+{
+	if((argc == 2) && !strcmp(argv[1], "reset"))
+		irqstat_reset();
+	else
+		irqstat_report();
+}
+
+/*
+ * PC sampler control - dump output is for tools/pcsym
+ */
+static void shell_pcs(int argc, char **argv)
+{
+	uint8_t err = 0;
+	uint32_t rate = 0;
+
+	if((argc >= 2) && !strcmp(argv[1], "start"))
+	{
+		if(argc > 2)
+			rate = shell_num(argv[2], &err);
+		if(err)
+			printf("bad number\n\r");
+		else
+			printf("sampling at %u Hz\n\r", pcsamp_start(rate));
+	}
+	else if((argc == 2) && !strcmp(argv[1], "stop"))
+		pcsamp_stop();
+	else if((argc == 2) && !strcmp(argv[1], "dump"))
+	{
+		pcsamp_stop();
+		pcsamp_dump();
+	}
+	else
+		printf("%u of %u samples - pcs [start [1-%u hz] | stop | dump]\n\r",
+			pcsamp_count(), PCSAMP_MAX, PCSAMP_RATE_MAX);
+}
+
+/*
+ * last start_meas/end_meas result
+ */
+static void shell_meas(int argc, char **argv)
+{
+	uint32_t act, tot;
+
+	get_meas(&act, &tot);
+	printf("active %u of %u cycles", act, tot);
+	if(tot)
+		printf(" (%d%%)", (uint32_t)((uint64_t)act * 100 / tot));
+	printf("\n\r");
+}
+
+/*
+ * read words - no address checks so a bad one faults
+ */
+static void shell_peek(int argc, char **argv)
+{
+	uint8_t err = 0;
+	uint32_t addr, cnt = 1, i;
+
+	if(argc < 2)
+	{
+		printf("usage: peek addr [words]\n\r");
+		return;
+	}
+	addr = shell_num(argv[1], &err) & ~3;
+	if(argc > 2)
+		cnt = shell_num(argv[2], &err);
+	if(err)
+	{
+		printf("bad number\n\r");
+		return;
+	}
+
+	for(i=0;i<cnt;i++,addr+=4)
+	{
+		if((i & 3) == 0)
+			printf("%s%08X:", i ? "\n\r" : "", addr);
+		printf(" %08X", *(volatile uint32_t *)addr);
+	}
+	printf("\n\r");
+}
+
+/*
+ * write a word - no address checks so a bad one faults
+ */
+static void shell_poke(int argc, char **argv)
+{
+	uint8_t err = 0;
+	uint32_t addr, val;
+
+	if(argc != 3)
+	{
+		printf("usage: poke addr value\n\r");
+		return;
+	}
+	addr = shell_num(argv[1], &err) & ~3;
+	val = shell_num(argv[2], &err);
+	if(err)
+	{
+		printf("bad number\n\r");
+		return;
+	}
+
+	*(volatile uint32_t *)addr = val;
+	printf("%08X: %08X\n\r", addr, *(volatile uint32_t *)addr);
+}
+
+/*
+ * add a command - name & help must stay valid. Returns nonzero if full.
+ */
+uint8_t shell_register(const char *name, const char *help, shell_fn fn)
+{
+	if(shell_numcmds >= SHELL_MAXCMDS)
+		return 1;
+
+	shell_cmds[shell_numcmds].name = name;
+	shell_cmds[shell_numcmds].help = help;
+	shell_cmds[shell_numcmds].fn = fn;
+	shell_numcmds++;
+
+	return 0;
+}
+
+/*
+ * set up the builtins & show a prompt - register others after this
+ */
+void shell_init(void)
+{
+	shell_numcmds = 0;
+	shell_len = 0;
+	shell_lastcr = 0;
+
+	shell_register("help", "list commands", shell_help);
+	shell_register("adc", "[mode n | rate hz] - show or set the scan", shell_adc);
+	shell_register("i2c", "I2C bus counters", shell_i2c);
+	shell_register("spi", "SPI port counters", shell_spi);
+	shell_register("uart", "USART counters", shell_uart);
+	shell_register("usb", "[test bytes] - USB counters or throughput test",
+		shell_usb);
+	shell_register("prof", "[reset] - profiler probes & CPU load",
+		shell_prof);
+	shell_register("pcs", "[start [1-50000 hz] | stop | dump] - PC sampler",
+		shell_pcs);
+	shell_register("sched", "[reset] - task timing & overruns",
+		shell_sched);
+	shell_register("boot", "init step timeline", shell_boot);
+	shell_register("irq", "[reset] - per-IRQ timing & IRQs-off windows",
+		shell_irq);
+	shell_register("meas", "last cycle measurement", shell_meas);
+	shell_register("peek", "addr [words] - read memory", shell_peek);
+	shell_register("poke", "addr value - write a word", shell_poke);
+
+	printf("type help for commands\n\r> ");
+}
+
+/*
+ * take input from somewhere other than the USART, e.g. usb_cdc_read
+ */
+void shell_set_input(shell_rd rd)
+{
+	shell_input = rd;
+}
+
+/*
+ * split a line & run it
+ */
+static void shell_exec(char *line)
+{
+	char *argv[SHELL_MAXARGS];
+	int argc = 0;
+	uint8_t i;
+
+	/* split on spaces */
+	while(*line && (argc < SHELL_MAXARGS))
+	{
+		while(*line == ' ')
+			*line++ = 0;
+		if(!*line)
+			break;
+		argv[argc++] = line;
+		while(*line && (*line != ' '))
+			line++;
+	}
+	if(!argc)
+		return;
+
+	for(i=0;i<shell_numcmds;i++)
+	{
+		if(!strcmp(argv[0], shell_cmds[i].name))
+		{
+			shell_cmds[i].fn(argc, argv);
+			return;
+		}
+	}
+	printf("%s? - try help\n\r", argv[0]);
+}
+
+/*
+ * call from the main loop - edits & runs lines as input arrives
+ */
+void shell_poll(void)
+{
+	char c;
+
+	while(shell_input(&c, 1))
+	{
+		switch(c)
+		{
+			case '\r':
+			case '\n':
+				/* CR, LF or CRLF all end a line */
+				if((c == '\n') && shell_lastcr)
+					break;
+				printf("\n\r");
+				shell_line[shell_len] = 0;
+				shell_exec(shell_line);
+				shell_len = 0;
+				printf("> ");
+				break;
+
+			case '\b':
+			case 0x7F:
+				if(shell_len)
+				{
+					shell_len--;
+					printf("\b \b");
+				}
+				break;
+
+			case 0x03:
+				/* ctrl-C drops the line */
+				shell_len = 0;
+				printf("^C\n\r> ");
+				break;
+
+			default:
+				if((c >= ' ') && (shell_len < SHELL_LINELEN-1))
+				{
+					shell_line[shell_len++] = c;
+					printf("%c", c);
+				}
+				break;
+		}
+		shell_lastcr = (c == '\r');
+	}
+}
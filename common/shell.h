@@ -0,0 +1,27 @@
+/*
+ * shell.h - command shell on the diagnostic console
+ */
+
+#ifndef __shell__
+#define __shell__
+
+#include "stm32f4xx_hal.h"
+
+/* limits */
+#define SHELL_MAXCMDS 24
+#define SHELL_LINELEN 80
+#define SHELL_MAXARGS 8
+
+/* command handler - argv[0] is the command name */
+typedef void (*shell_fn)(int argc, char **argv);
+
+/* input source - returns the number of bytes read, 0 if none waiting */
+typedef uint32_t (*shell_rd)(void *buf, uint32_t max);
+
+void shell_init(void);
+void shell_set_input(shell_rd rd);
+uint8_t shell_register(const char *name, const char *help, shell_fn fn);
+uint32_t shell_num(const char *s, uint8_t *err);
+void shell_poll(void);
+
+#endif
@@ -0,0 +1,296 @@
+/*
+ * spectrum.c - FFT spectrum analyzer view on the TFT Wing
+ *
+ * Each frame is one untriggered capture that is windowed, transformed and
+ * drawn as 160 bars of peak-hold dB across 0 to fs/2, one dB per pixel
+ * below full scale. Each bar jumps up to a new peak and then falls back
+ * by SPEC_DECAY dB a frame. Only the part of a bar that changed is sent.
+ *
+ * Buttons: left/right sample rate, up/down FFT size, select run/hold.
+ */
+
+#include "spectrum.h"
+#include "adc_capture.h"
+#include "rfft.h"
+#include "st7735.h"
+#include "tftwing.h"
+#include "cyclesleep.h"
+#include "printf.h"
+
+/* screen geometry */
+#define SPEC_W 160
+#define SPEC_TOP 8
+#define SPEC_H 72
+#define SPEC_YDIV 18
+
+/* colors */
+#define SPEC_BG ST7735_BLACK
+#define SPEC_GRID 0x4208
+#define SPEC_BAR ST7735_CYAN
+#define SPEC_TEXT ST7735_GREEN
+
+/* peak hold fall rate in dB per frame */
+#define SPEC_DECAY 2.0F
+
+/* below the bottom of the graph so the next frame sets every bar */
+#define SPEC_FLOOR -1000.0F
+
+/* button poll interval */
+#define SPEC_BTN_FRAMES 4
+
+/* sample time codes from fastest to slowest */
+const uint8_t spec_smp[] =
+{
+	ADC_SAMPLETIME_3CYCLES,
+	ADC_SAMPLETIME_15CYCLES,
+	ADC_SAMPLETIME_56CYCLES,
+	ADC_SAMPLETIME_144CYCLES,
+	ADC_SAMPLETIME_480CYCLES,
+};
+#define SPEC_NUMSMP (sizeof(spec_smp)/sizeof(spec_smp[0]))
+
+/* state */
+uint8_t spec_chl, spec_smpidx, spec_log2n, spec_run, spec_frames;
+uint8_t spec_old[SPEC_W];
+uint32_t spec_btns, spec_cycles;
+uint16_t spec_col[SPEC_H];
+float32_t spec_hold[SPEC_W];
+
+/*
+ * raw samples, spectrum and dB all share one buffer - CPU only so CCM is
+ * ok. It's a union so the raw & float views don't break strict aliasing.
+ */
+union
+{
+	float32_t f[RFFT_MAXN];
+	uint16_t raw[RFFT_MAXN];
+} spec_buf __attribute__ ((section (".ccmram")));
+
+/*
+ * background color at a screen row - dotted dB lines
+ */
+static uint16_t spec_bg(uint8_t x, uint8_t y)
+{
+	y -= SPEC_TOP;
+	if(((y % SPEC_YDIV) == 0) && ((x & 3) == 0))
+		return SPEC_GRID;
+	return SPEC_BG;
+}
+
+/*
+ * move the top of one bar, sending only the rows that changed
+ */
+static void spec_bar(uint8_t x, uint8_t top)
+{
+	uint8_t old = spec_old[x], y0, y1, y;
+	uint16_t *p = spec_col;
+
+	if(top == old)
+		return;
+
+	if(top < old)
+	{
+		/* growing */
+		y0 = top;
+		y1 = old - 1;
+	}
+	else
+	{
+		/* shrinking */
+		y0 = old;
+		y1 = top - 1;
+	}
+
+	/* colors are byte swapped for bitblt */
+	for(y=y0;y<=y1;y++)
+	{
+		if(y >= top)
+			*p++ = __REVSH(SPEC_BAR);
+		else
+			*p++ = __REVSH(spec_bg(x, y));
+	}
+	ST7735_bitblt(x, y0, 1, y1-y0+1, spec_col);
+
+	spec_old[x] = top;
+}
+
+/*
+ * dB to bar top row
+ */
+static uint8_t spec_y(float32_t db)
+{
+	int32_t y = SPEC_TOP - (int32_t)db;
+
+	if(y < SPEC_TOP)
+		y = SPEC_TOP;
+	else if(y > SPEC_TOP + SPEC_H)
+		y = SPEC_TOP + SPEC_H;
+
+	return y;
+}
+
+/*
+ * drop the held peaks, e.g. when the bins change meaning
+ */
+static void spec_hold_reset(void)
+{
+	uint8_t x;
+
+	for(x=0;x<SPEC_W;x++)
+		spec_hold[x] = SPEC_FLOOR;
+}
+
+/*
+ * status line - size, peak frequency & level
+ */
+static void spec_status(float32_t bin, float32_t level)
+{
+	char txtbuf[24];
+	uint16_t n = 1 << spec_log2n;
+	uint32_t hz = (uint32_t)(bin * (float32_t)ADC_CapGetRate() / (float32_t)n);
+
+	snprintf(txtbuf, sizeof(txtbuf), "%4d %6dHz %3ddB%c", n, hz,
+		(int32_t)level, spec_run ? ' ' : 'H');
+	ST7735_drawstr(0, 0, txtbuf, SPEC_TEXT, ST7735_BLACK);
+}
+
+/*
+ * start the next capture - software trigger fires as soon as it's armed
+ */
+static void spec_arm(void)
+{
+	ADC_CapStart(spec_chl, spec_smp[spec_smpidx], 0, 1 << spec_log2n,
+		ADC_CAP_TRIG_SW, 0, 0, NULL);
+	ADC_CapTrigger();
+}
+
+/*
+ * transform and draw a finished capture
+ */
+static void spec_render(void)
+{
+	uint16_t n = 1 << spec_log2n, nbins = n/2, i, b0, b1;
+	float32_t bin, level, pk;
+	uint32_t tot;
+	uint8_t x;
+
+	if(ADC_CapRead(spec_buf.raw, n) < n)
+		return;
+
+	/* widen in place from the top down so no sample is overwritten early */
+	i = n;
+	while(i--)
+		spec_buf.f[i] = ((float32_t)spec_buf.raw[i] - 2048.0F) *
+			(1.0F/2048.0F);
+
+	start_meas();
+	rfft_window(spec_buf.f, n);
+	rfft(spec_buf.f, n);
+	rfft_db(spec_buf.f, spec_buf.f, n, (float32_t)(n/4));
+	end_meas();
+	get_meas(&spec_cycles, &tot);
+
+	/* each bar holds the largest bin it covers, decaying between peaks */
+	for(x=0;x<SPEC_W;x++)
+	{
+		b0 = (uint32_t)x * nbins / SPEC_W;
+		b1 = (uint32_t)(x+1) * nbins / SPEC_W;
+		pk = spec_buf.f[b0];
+		for(i=b0+1;i<b1;i++)
+			if(spec_buf.f[i] > pk)
+				pk = spec_buf.f[i];
+		spec_hold[x] -= SPEC_DECAY;
+		if(pk > spec_hold[x])
+			spec_hold[x] = pk;
+		spec_bar(x, spec_y(spec_hold[x]));
+	}
+
+	bin = rfft_peak(spec_buf.f, nbins, &level);
+	spec_status(bin, level);
+}
+
+/*
+ * handle button presses - buttons read low when pressed
+ */
+static void spec_buttons(void)
+{
+	uint32_t btns = ~tftwing_readButtons() & TFTWING_BUTTON_ALL;
+	uint32_t press = btns & ~spec_btns;
+
+	spec_btns = btns;
+
+	/* new rate or size moves the bins under the bars */
+	if(press & (TFTWING_BUTTON_LEFT | TFTWING_BUTTON_RIGHT |
+		TFTWING_BUTTON_UP | TFTWING_BUTTON_DOWN))
+		spec_hold_reset();
+
+	if((press & TFTWING_BUTTON_RIGHT) && (spec_smpidx < SPEC_NUMSMP-1))
+		spec_smpidx++;
+	if((press & TFTWING_BUTTON_LEFT) && (spec_smpidx > 0))
+		spec_smpidx--;
+	if((press & TFTWING_BUTTON_UP) && (spec_log2n < RFFT_MAXLOG2))
+		spec_log2n++;
+	if((press & TFTWING_BUTTON_DOWN) && (spec_log2n > RFFT_MINLOG2))
+		spec_log2n--;
+	if(press & TFTWING_BUTTON_SELECT)
+		spec_run = !spec_run;
+}
+
+/*
+ * start the analyzer on an ADC channel
+ */
+void spectrum_init(uint8_t chl)
+{
+	uint8_t x;
+
+	spec_chl = chl;
+	spec_smpidx = 0;
+	spec_log2n = 10;
+	spec_run = 1;
+	spec_frames = 0;
+	spec_btns = 0;
+	spec_cycles = 0;
+	spec_hold_reset();
+
+	rfft_init();
+
+	/* draw the empty graticule */
+	ST7735_fillScreen(ST7735_BLACK);
+	for(x=0;x<SPEC_W;x++)
+	{
+		spec_old[x] = SPEC_TOP + SPEC_H;
+		spec_bar(x, SPEC_TOP);
+		spec_bar(x, SPEC_TOP + SPEC_H);
+	}
+
+	spec_arm();
+}
+
+/*
+ * call from the main loop - never blocks on the capture
+ */
+void spectrum_update(void)
+{
+	if(ADC_CapState() != ADC_CAP_DONE)
+		return;
+
+	if(spec_run)
+		spec_render();
+
+	/* I2C button reads are slow so don't do them every frame */
+	if(++spec_frames >= SPEC_BTN_FRAMES)
+	{
+		spec_frames = 0;
+		spec_buttons();
+	}
+
+	spec_arm();
+}
+
+/*
+ * cycles spent on window, FFT and dB for the last frame
+ */
+uint32_t spectrum_get_cycles(void)
+{
+	return spec_cycles;
+}
@@ -0,0 +1,14 @@
+/*
+ * spectrum.h - FFT spectrum analyzer view on the TFT Wing
+ */
+
+#ifndef __spectrum__
+#define __spectrum__
+
+#include "stm32f4xx_hal.h"
+
+void spectrum_init(uint8_t chl);
+void spectrum_update(void);
+uint32_t spectrum_get_cycles(void);
+
+#endif
@@ -272,9 +272,14 @@ void ST7735_write_byte(uint16_t dat)
 }
 
 /* ----------------------- Public functions ----------------------- */
-// Initialization for ST7735R red tab screens
-void ST7735_init(void)
+// Initialization for ST7735R red tab screens - the reset & the list
+// delays wait in the thread
+uint8_t ST7735_init_pt(pt_ctx *pt)
 {
+	static const uint16_t *addr;
+
+	PT_BEGIN(pt);
+
 	// init the SPI port
 	ST7735_SPI_Init();
 
@@ -287,25 +292,31 @@ void ST7735_init(void)
 
 	// Reset it
 	tftwing_tftReset(0);
-	HAL_Delay(10);
+	PT_DELAY_MS(pt, 10);
 	tftwing_tftReset(1);
-	HAL_Delay(10);
+	PT_DELAY_MS(pt, 10);
 
 	// Send init command list
-	uint16_t *addr = (uint16_t *)initlst, ms;
+	addr = initlst;
 	while(*addr != ST_CMD_END)
 	{
 		if((*addr & ST_CMD_DELAY) != ST_CMD_DELAY)
 			ST7735_write_byte(*addr++);
 		else
-		{
-			ms = (*addr++)&0x1ff;        // strip delay time (ms)
-			HAL_Delay(ms);
-		}
+			PT_DELAY_MS(pt, (*addr++)&0x1ff);    // strip delay time (ms)
 	}
 
 	// turn on the backlight
 	tftwing_setBacklight(0);
+
+	PT_END(pt);
+}
+
+void ST7735_init(void)
+{
+	pt_ctx pt;
+
+	PT_RUN(&pt, ST7735_init_pt(&pt));
 }
 
 // opens a window into display mem for bitblt
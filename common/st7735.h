@@ -15,6 +15,7 @@ extern "C" {
 #endif
 
 #include "stm32f4xx_hal.h"
+#include "pt.h"
 
 // dimensions for LCD on tiny TFT wing
 #define ST7735_TFTWIDTH 80
@@ -30,6 +31,7 @@ extern "C" {
 #define ST7735_YELLOW  0xFFE0  
 #define ST7735_WHITE   0xFFFF
 
+uint8_t ST7735_init_pt(pt_ctx *pt);
 void ST7735_init(void);
 void ST7735_setAddrWindow(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1);
 void ST7735_fillScreen(uint16_t color);
@@ -7,6 +7,7 @@
 #include "shared_i2c.h"
 #include "printf.h"
 #include "cyclesleep.h"
+#include "pt.h"
 
 #define TFTWING_ADDR (0x5E<<1)
 #define TFTWING_RESET_PIN 8
@@ -85,40 +86,45 @@ void tftwing_i2c_error(uint8_t code)
 }
 
 /*
- * read a buffer from seesaw
+ * read a buffer from seesaw - the register address goes first and the
+ * data needs a gap before it can be read back
  */
-uint32_t seesaw_readbuf(uint8_t reghi, uint8_t reglo, uint8_t *buf, uint8_t sz)
+uint8_t seesaw_readbuf_pt(pt_ctx *pt, uint8_t reghi, uint8_t reglo,
+	uint8_t *buf, uint8_t sz)
 {
-	HAL_StatusTypeDef status = HAL_OK;
 	uint8_t i2c_msg[2];
-	
-	/* build message */
-	i2c_msg[0] = reghi;
-	i2c_msg[1] = reglo;
 
-	/* send reg addr */
-	status = HAL_I2C_Master_Transmit(&hi2c1, TFTWING_ADDR, i2c_msg, 2, 100);
+	PT_BEGIN(pt);
 
-	/* Check the communication status */
-	if(status != HAL_OK)
+	/* send reg addr */
+	i2c_msg[0] = reghi;
+	i2c_msg[1] = reglo;
+	if(shared_i2c_write(TFTWING_ADDR, i2c_msg, 2, 100) != HAL_OK)
 	{
 		tftwing_i2c_error(1);
-		return status;
+		PT_EXIT(pt);
 	}
 	
 	/* delay 100us */
-	cyclesleep(16800);
+	PT_DELAY(pt, SystemCoreClock/10000);
 	
 	/* receive data */
-	status = HAL_I2C_Master_Receive(&hi2c1, TFTWING_ADDR, buf, sz, 100);
-
-	/* Check the communication status */
-	if(status != HAL_OK)
+	if(shared_i2c_read(TFTWING_ADDR, buf, sz, 100) != HAL_OK)
 	{
 		tftwing_i2c_error(2);
+		PT_EXIT(pt);
 	}
 
-	return status;
+	PT_END(pt);
+}
+
+uint32_t seesaw_readbuf(uint8_t reghi, uint8_t reglo, uint8_t *buf, uint8_t sz)
+{
+	pt_ctx pt;
+
+	PT_RUN(&pt, seesaw_readbuf_pt(&pt, reghi, reglo, buf, sz));
+
+	return pt.state == PT_ENDED ? HAL_OK : HAL_ERROR;
 }
 
 /*
@@ -139,7 +145,7 @@ uint32_t seesaw_writebuf(uint8_t reghi, uint8_t reglo, uint8_t *buf, uint8_t sz)
 		i2c_msg[i+2]=buf[i];
 	
 	/* send reg addr */
-	status = HAL_I2C_Master_Transmit(&hi2c1, TFTWING_ADDR, i2c_msg, 2+sz, 100);
+	status = shared_i2c_write(TFTWING_ADDR, i2c_msg, 2+sz, 100);
 
 	/* Check the communication status */
 	if(status != HAL_OK)
@@ -151,30 +157,38 @@ uint32_t seesaw_writebuf(uint8_t reghi, uint8_t reglo, uint8_t *buf, uint8_t sz)
 }
 
 /*
- * software reset to seesaw
+ * software reset to seesaw - it needs half a second to come back
  */
-uint32_t seesaw_swrst(void)
+uint8_t seesaw_swrst_pt(pt_ctx *pt)
 {
-	HAL_StatusTypeDef status = HAL_OK;
 	uint8_t i2c_msg[3];
 	
+	PT_BEGIN(pt);
+
 	/* build message */
 	i2c_msg[0] = SEESAW_STATUS_BASE;
 	i2c_msg[1] = SEESAW_STATUS_SWRST;
 	i2c_msg[2] = 0xFF;
 	
 	/* send reg addr */
-	status = HAL_I2C_Master_Transmit(&hi2c1, TFTWING_ADDR, i2c_msg, 3, 100);
-
-	/* Check the communication status */
-	if(status != HAL_OK)
+	if(shared_i2c_write(TFTWING_ADDR, i2c_msg, 3, 100) != HAL_OK)
 	{
 		tftwing_i2c_error(4);
+		PT_EXIT(pt);
 	}
 	
-	HAL_Delay(500);
+	PT_DELAY_MS(pt, 500);
 
-	return status;
+	PT_END(pt);
+}
+
+uint32_t seesaw_swrst(void)
+{
+	pt_ctx pt;
+
+	PT_RUN(&pt, seesaw_swrst_pt(&pt));
+
+	return pt.state == PT_ENDED ? HAL_OK : HAL_ERROR;
 }
 
 /*
@@ -238,42 +252,58 @@ void seesaw_digitalWriteBulk(uint32_t pins, uint8_t value)
 }
 
 /*
- * start up interface to tftwing
+ * start up interface to tftwing - PT_EXITED if it's not there
  * for some reason this fails if it's the first I2C thing done
  * so do something else first (init other periphs on bus)
  */
-uint8_t tftwing_init(void)
+uint8_t tftwing_init_pt(pt_ctx *pt)
 {
-	uint8_t id = 0;
+	static pt_ctx child;
+	static uint8_t id;
 	
+	PT_BEGIN(pt);
+
 	/* dummy write seems to help seesaw wake up */
-	HAL_I2C_Master_Transmit(&hi2c1, 0x10, &id, 1, 100);
+	id = 0;
+	shared_i2c_write(0x10, &id, 1, 100);
 
 	/* reset the seesaw */
-	if(seesaw_swrst())
+	PT_SPAWN(pt, &child, seesaw_swrst_pt(&child));
+	if(child.state != PT_ENDED)
 	{
 		printf("tftwing_init: SWRst failed\n\r");
-		return 1;
+		PT_EXIT(pt);
 	}
 	
 	/* get the seesaw ID */
-	if(seesaw_readbuf(SEESAW_STATUS_BASE, SEESAW_STATUS_HW_ID, &id, 1))
+	PT_SPAWN(pt, &child, seesaw_readbuf_pt(&child, SEESAW_STATUS_BASE,
+		SEESAW_STATUS_HW_ID, &id, 1));
+	if(child.state != PT_ENDED)
 	{
 		printf("tftwing_init: ID read failed\n\r");
-		return 1;
+		PT_EXIT(pt);
 	}
 	
 	/* check for correct ID */
 	if(id != SEESAW_HW_ID_CODE)
 	{
 		printf("tftwing_init: ID code mismatch\n\r");
-		return 1;
+		PT_EXIT(pt);
 	}
 	
 	seesaw_pinModeBulk((1<<TFTWING_RESET_PIN), SEESAW_GPIO_MODE_OUTPUT);
 	seesaw_pinModeBulk(TFTWING_BUTTON_ALL, SEESAW_GPIO_MODE_INPUT_PULLUP);
 
-	return 0;
+	PT_END(pt);
+}
+
+uint8_t tftwing_init(void)
+{
+	pt_ctx pt;
+
+	PT_RUN(&pt, tftwing_init_pt(&pt));
+
+	return pt.state != PT_ENDED;
 }
 
 /*
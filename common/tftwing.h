@@ -7,6 +7,7 @@
 #define __tftwing__
 
 #include "stm32f4xx.h"
+#include "pt.h"
 
 #define TFTWING_BACKLIGHT_ON 0       // inverted output!
 #define TFTWING_BACKLIGHT_OFF 0xFFFF // inverted output!
@@ -37,6 +38,7 @@
    TFTWING_BUTTON_RIGHT | TFTWING_BUTTON_SELECT | TFTWING_BUTTON_A |           \
    TFTWING_BUTTON_B)
 
+uint8_t tftwing_init_pt(pt_ctx *pt);
 uint8_t tftwing_init(void);
 void tftwing_setBacklight(uint16_t value);
 void tftwing_setBacklightFreq(uint16_t freq);
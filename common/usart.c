@@ -4,6 +4,9 @@
  */
 
 #include "usart.h"
+#include "irqstat.h"
+#include "idle.h"
+#include <string.h>
 
 #define USART_TX_Pin GPIO_PIN_10
 #define USART_TX_GPIO_Port GPIOB
@@ -13,6 +16,27 @@
 //USART_HandleTypeDef UsartHandle;
 UART_HandleTypeDef huart3;
 
+/*
+ * TX ring drained by DMA1 Stream3. Indices are free-running: the DMA
+ * owns dma_start..tail, queued data is tail..head. DMA transfers are
+ * capped at a quarter of the ring so overwrite can always make room.
+ */
+#define USART_TXCHUNK (USART_TXBUFSZ/4)
+uint8_t usart_txbuf[USART_TXBUFSZ];
+volatile uint32_t usart_head, usart_tail, usart_dma_start, usart_dma_len;
+volatile uint8_t usart_dma_busy;
+uint8_t usart_policy = USART_TX_DROP;
+usart_stats usart_st;
+
+/*
+ * RX ring filled by circular DMA1 Stream1. The write position is the
+ * lap count plus where NDTR says the DMA is, the read position belongs
+ * to the main loop. The IDLE interrupt marks the end of each burst.
+ */
+uint8_t usart_rxbuf[USART_RXBUFSZ];
+volatile uint32_t usart_rx_laps, usart_rx_idle;
+uint32_t usart_rx_rd;
+
 /**
   * @brief  This function is executed in case of error occurrence.
   * @param  None
@@ -62,6 +86,159 @@ void setup_usart(void)
 	{
 		Error_Handler();
 	}
+
+	/* TX DMA - DMA1 Stream3 channel 4, bytes to DR */
+	__HAL_RCC_DMA1_CLK_ENABLE();
+	DMA1_Stream3->CR = 0;
+	while(DMA1_Stream3->CR & DMA_SxCR_EN)
+	{
+	}
+	DMA1_Stream3->PAR = (uint32_t)&USART3->DR;
+	DMA1_Stream3->FCR = 0;
+	DMA1_Stream3->CR = DMA_CHANNEL_4 | DMA_PRIORITY_LOW | DMA_MINC_ENABLE |
+		DMA_MEMORY_TO_PERIPH | DMA_IT_TC;
+	USART3->CR3 |= USART_CR3_DMAT;
+
+	usart_head = usart_tail = usart_dma_start = 0;
+	usart_dma_busy = 0;
+	memset(&usart_st, 0, sizeof(usart_st));
+
+	HAL_NVIC_SetPriority(DMA1_Stream3_IRQn, 7, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Stream3_IRQn);
+
+	/* RX DMA - DMA1 Stream1 channel 4, DR to ring, circular */
+	DMA1_Stream1->CR = 0;
+	while(DMA1_Stream1->CR & DMA_SxCR_EN)
+	{
+	}
+	DMA1_Stream1->PAR = (uint32_t)&USART3->DR;
+	DMA1_Stream1->M0AR = (uint32_t)usart_rxbuf;
+	DMA1_Stream1->NDTR = USART_RXBUFSZ;
+	DMA1_Stream1->FCR = 0;
+	DMA1_Stream1->CR = DMA_CHANNEL_4 | DMA_PRIORITY_MEDIUM | DMA_MINC_ENABLE |
+		DMA_CIRCULAR | DMA_PERIPH_TO_MEMORY | DMA_IT_TC;
+	usart_rx_laps = usart_rx_idle = usart_rx_rd = 0;
+	DMA1->LIFCR = DMA_LIFCR_CTCIF1 | DMA_LIFCR_CHTIF1 | DMA_LIFCR_CTEIF1 |
+		DMA_LIFCR_CDMEIF1 | DMA_LIFCR_CFEIF1;
+	DMA1_Stream1->CR |= DMA_SxCR_EN;
+	USART3->CR3 |= USART_CR3_DMAR;
+
+	/* idle line ends a burst */
+	USART3->CR1 |= USART_CR1_IDLEIE;
+	HAL_NVIC_SetPriority(DMA1_Stream1_IRQn, 7, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Stream1_IRQn);
+	HAL_NVIC_SetPriority(USART3_IRQn, 7, 0);
+	HAL_NVIC_EnableIRQ(USART3_IRQn);
+}
+
+/*
+ * hand the next contiguous run of queued data to the DMA - IRQs masked
+ */
+static void usart_kick(void)
+{
+	uint32_t len = usart_head - usart_tail;
+	uint32_t idx = usart_tail & (USART_TXBUFSZ-1);
+
+	if(usart_dma_busy || !len)
+		return;
+
+	if(len > USART_TXBUFSZ - idx)
+		len = USART_TXBUFSZ - idx;
+	if(len > USART_TXCHUNK)
+		len = USART_TXCHUNK;
+
+	usart_dma_start = usart_tail;
+	usart_dma_len = len;
+	usart_tail += len;
+	usart_dma_busy = 1;
+
+	DMA1->LIFCR = DMA_LIFCR_CTCIF3 | DMA_LIFCR_CHTIF3 | DMA_LIFCR_CTEIF3 |
+		DMA_LIFCR_CDMEIF3 | DMA_LIFCR_CFEIF3;
+	DMA1_Stream3->M0AR = (uint32_t)&usart_txbuf[idx];
+	DMA1_Stream3->NDTR = len;
+	DMA1_Stream3->CR |= DMA_SxCR_EN;
+}
+
+/*
+ * free space in the ring - in-flight DMA data still holds its space
+ */
+static uint32_t usart_space(void)
+{
+	return USART_TXBUFSZ - (usart_head - (usart_dma_busy ?
+		usart_dma_start : usart_tail));
+}
+
+/*
+ * bytes that can be queued right now - mask IRQs to keep it valid
+ */
+uint32_t usart_tx_free(void)
+{
+	return usart_space();
+}
+
+/*
+ * queue len bytes - returns the number accepted. Blocking waits for the
+ * DMA unless called from an IRQ or with IRQs masked, where it drops.
+ */
+uint32_t usart_write(const void *buf, uint32_t len)
+{
+	const uint8_t *src = buf;
+	uint32_t prim, space, idx, n, done = 0;
+
+	while(len)
+	{
+		IRQ_LOCK(prim);
+
+		space = usart_space();
+		if((space < len) && (usart_policy == USART_TX_OVERWRITE))
+		{
+			/*
+			 * the free space ends where the DMA is reading so the old
+			 * data can't be overwritten in place - discard the whole
+			 * unsent backlog and restart right after the DMA
+			 */
+			usart_st.overwritten += usart_head - usart_tail;
+			usart_head = usart_tail;
+			space = usart_space();
+		}
+		if((space < len) && (usart_policy == USART_TX_BLOCK) &&
+			!prim && !__get_IPSR() && (space < USART_TXCHUNK))
+		{
+			/* let the DMA catch up a bit */
+			IRQ_UNLOCK(prim);
+			continue;
+		}
+
+		/* copy what fits - two pieces if it wraps */
+		n = len < space ? len : space;
+		idx = usart_head & (USART_TXBUFSZ-1);
+		if(n > USART_TXBUFSZ - idx)
+		{
+			memcpy(&usart_txbuf[idx], src, USART_TXBUFSZ - idx);
+			memcpy(usart_txbuf, src + USART_TXBUFSZ - idx,
+				n - (USART_TXBUFSZ - idx));
+		}
+		else
+			memcpy(&usart_txbuf[idx], src, n);
+		usart_head += n;
+		usart_st.queued += n;
+		if(USART_TXBUFSZ - usart_space() > usart_st.peak)
+			usart_st.peak = USART_TXBUFSZ - usart_space();
+		usart_kick();
+		src += n;
+		len -= n;
+		done += n;
+
+		/* only blocking mode comes back for the rest */
+		if(len && (usart_policy != USART_TX_BLOCK || prim || __get_IPSR()))
+		{
+			usart_st.dropped += len;
+			len = 0;
+		}
+		IRQ_UNLOCK(prim);
+	}
+
+	return done;
 }
 
 /*
@@ -69,8 +246,152 @@ void setup_usart(void)
  */
 void usart_putc(void* p, char c)
 {
+	usart_write(&c, 1);
+}
+
+/*
+ * set what happens when the ring is full
+ */
+void usart_set_policy(uint8_t policy)
+{
+	usart_policy = policy;
+}
+
+/*
+ * wait for everything queued to go out
+ */
+void usart_flush(void)
+{
+	while(usart_dma_busy || (usart_head != usart_tail))
+	{
+	}
 	while(__HAL_UART_GET_FLAG(&huart3, UART_FLAG_TC) == RESET)
 	{
 	}
-	USART3->DR = c;
+}
+
+/*
+ * get a copy of the counters
+ */
+void usart_get_stats(usart_stats *st)
+{
+	uint32_t prim;
+
+	IRQ_LOCK(prim);
+	*st = usart_st;
+	IRQ_UNLOCK(prim);
+}
+
+/*
+ * free-running RX write position. The DMA can wrap before its TC IRQ
+ * runs - always so with IRQs masked or at priority 7 or above - so a
+ * pending TC flag with NDTR reloaded high counts as the lap not yet
+ * taken. A flag with NDTR still low is a wrap after NDTR was read.
+ */
+static uint32_t usart_rx_wr(void)
+{
+	uint32_t laps, ndtr, tc;
+
+	/* retry if the TC IRQ ran while we looked */
+	do
+	{
+		laps = usart_rx_laps;
+		ndtr = DMA1_Stream1->NDTR;
+		tc = DMA1->LISR & DMA_LISR_TCIF1;
+	}
+	while(laps != usart_rx_laps);
+	if(tc && (ndtr > USART_RXBUFSZ/2))
+		laps++;
+
+	return laps*USART_RXBUFSZ + USART_RXBUFSZ - ndtr;
+}
+
+/*
+ * bytes waiting to be read
+ */
+uint32_t usart_rx_avail(void)
+{
+	uint32_t avail = usart_rx_wr() - usart_rx_rd;
+
+	/* lapped - keep the newest ring's worth */
+	if(avail > USART_RXBUFSZ)
+	{
+		usart_st.rx_lost += avail - USART_RXBUFSZ;
+		usart_rx_rd += avail - USART_RXBUFSZ;
+		avail = USART_RXBUFSZ;
+	}
+
+	return avail;
+}
+
+/*
+ * read up to max bytes - returns the number read, never waits
+ */
+uint32_t usart_read(void *buf, uint32_t max)
+{
+	uint8_t *dst = buf;
+	uint32_t n = usart_rx_avail(), i;
+
+	if(n > max)
+		n = max;
+	for(i=0;i<n;i++)
+		*dst++ = usart_rxbuf[usart_rx_rd++ & (USART_RXBUFSZ-1)];
+	usart_st.received += n;
+
+	return n;
+}
+
+/*
+ * bursts ended by an idle line so far - changes when new input is done
+ */
+uint32_t usart_rx_bursts(void)
+{
+	return usart_rx_idle;
+}
+
+/*
+ * RX DMA wrapped
+ */
+IRQSTAT_HANDLER(DMA1_Stream1_IRQHandler)
+{
+	if(DMA1->LISR & DMA_LISR_TCIF1)
+	{
+		DMA1->LIFCR = DMA_LIFCR_CTCIF1;
+		usart_rx_laps++;
+	}
+}
+
+/*
+ * USART3 - idle line & errors, data itself goes by DMA
+ */
+IRQSTAT_HANDLER(USART3_IRQHandler)
+{
+	uint32_t sr = USART3->SR;
+
+	/* IDLE, ORE, NE & FE clear by reading SR then DR */
+	if(sr & (USART_SR_IDLE | USART_SR_ORE | USART_SR_NE | USART_SR_FE))
+	{
+		(void)USART3->DR;
+		if(sr & USART_SR_IDLE)
+		{
+			usart_rx_idle++;
+			idle_post(IDLE_EV_RX);
+		}
+		if(sr & (USART_SR_ORE | USART_SR_NE | USART_SR_FE))
+			usart_st.rx_errors++;
+	}
+}
+
+/*
+ * TX DMA done - release the space and start the next run
+ */
+IRQSTAT_HANDLER(DMA1_Stream3_IRQHandler)
+{
+	if(!(DMA1->LISR & DMA_LISR_TCIF3))
+		return;
+	DMA1->LIFCR = DMA_LIFCR_CTCIF3;
+
+	usart_st.sent += usart_dma_len;
+	usart_dma_busy = 0;
+	usart_kick();
 }
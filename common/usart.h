@@ -12,8 +12,41 @@ extern "C" {
 
 #include "stm32f4xx_hal.h"
 
+/* ring sizes - must be powers of 2 */
+#define USART_TXBUFSZ 1024
+#define USART_RXBUFSZ 256
+
+/* what to do when the TX ring is full */
+enum usart_tx_policy
+{
+	USART_TX_DROP,          // keep old data, lose the new
+	USART_TX_OVERWRITE,     // lose the unsent backlog, keep the new
+	USART_TX_BLOCK,         // wait for room, drops from IRQs
+};
+
+/* counters in bytes */
+typedef struct
+{
+	uint32_t queued;        /* accepted into the ring */
+	uint32_t sent;          /* completed by DMA */
+	uint32_t dropped;       /* rejected when full */
+	uint32_t overwritten;   /* backlog discarded by USART_TX_OVERWRITE */
+	uint32_t peak;          /* most bytes held at once */
+	uint32_t received;      /* read from the RX ring */
+	uint32_t rx_lost;       /* RX overwritten before being read */
+	uint32_t rx_errors;     /* overrun, noise & framing errors */
+} usart_stats;
+
 void setup_usart(void);
+uint32_t usart_write(const void *buf, uint32_t len);
+uint32_t usart_tx_free(void);
 void usart_putc(void* p, char c);
+void usart_set_policy(uint8_t policy);
+void usart_flush(void);
+void usart_get_stats(usart_stats *st);
+uint32_t usart_rx_avail(void);
+uint32_t usart_read(void *buf, uint32_t max);
+uint32_t usart_rx_bursts(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,693 @@
+/*
+ * usb_cdc.c - USB full-speed CDC-ACM virtual COM port
+ *
+ * Runs on the OTG_FS core through HAL_PCD with just enough of the
+ * standard & CDC class requests to enumerate as a serial port. There's no
+ * USB middleware - the HAL_PCD callbacks below are the whole stack.
+ */
+
+#include <string.h>
+#include "usb_cdc.h"
+#include "cyclesleep.h"
+#include "irqstat.h"
+#include "idle.h"
+
+/* endpoints */
+#define USB_CDC_OUT_EP 0x01
+#define USB_CDC_IN_EP 0x81
+#define USB_CDC_CMD_EP 0x82
+
+/* longest a blocked write waits for the host */
+#define USB_CDC_TIMEOUT 20
+
+/* one IN transfer - the core splits it into packets by itself */
+#define USB_CDC_TXCHUNK (USB_CDC_TXBUFSZ/2)
+
+/* control transfer stages */
+enum usb_cdc_ep0states
+{
+	USB_CDC_EP0_IDLE,
+	USB_CDC_EP0_DATA_IN,
+	USB_CDC_EP0_DATA_OUT,
+	USB_CDC_EP0_STATUS_IN,
+	USB_CDC_EP0_STATUS_OUT,
+};
+
+PCD_HandleTypeDef hpcd;
+
+/*
+ * TX ring read directly by the IN endpoint - indices are free-running
+ * and tail only moves when a transfer completes, so in-flight data keeps
+ * its space. OTG_FS moves FIFO data with the CPU, not DMA, so the ring
+ * can live in CCM.
+ */
+uint8_t usb_cdc_txbuf[USB_CDC_TXBUFSZ] __attribute__ ((section (".ccmram")));
+volatile uint32_t usb_cdc_head, usb_cdc_tail, usb_cdc_txlen;
+volatile uint8_t usb_cdc_busy, usb_cdc_zlp;
+volatile uint32_t usb_cdc_test_rem;
+uint8_t usb_cdc_test_seq;
+
+/*
+ * RX ring filled a packet at a time. The OUT endpoint is only armed
+ * while a whole packet fits so the host gets NAKed instead of losing data.
+ */
+uint8_t usb_cdc_rxbuf[USB_CDC_RXBUFSZ];
+uint8_t usb_cdc_rxpkt[USB_CDC_MPS];
+volatile uint32_t usb_cdc_rx_wr, usb_cdc_rx_rd;
+volatile uint8_t usb_cdc_rx_held;
+
+volatile usb_cdc_stats usb_cdc_st;
+
+/* control endpoint */
+uint8_t usb_cdc_ep0state;
+const uint8_t *usb_cdc_ep0ptr;
+uint16_t usb_cdc_ep0rem;
+uint8_t usb_cdc_ep0zlp;
+uint8_t usb_cdc_ep0buf[USB_CDC_MPS];
+
+/* 115200 8N1 - only stored for the host to read back */
+uint8_t usb_cdc_linecoding[7] = {0x00, 0xC2, 0x01, 0x00, 0, 0, 8};
+
+const uint8_t usb_cdc_devdesc[18] =
+{
+	18, 0x01,           /* device */
+	0x00, 0x02,         /* USB 2.0 */
+	0x02, 0x00, 0x00,   /* CDC class at device level */
+	USB_CDC_MPS,
+	0x83, 0x04,         /* VID 0x0483 */
+	0x40, 0x57,         /* PID 0x5740 - ST virtual COM port */
+	0x00, 0x02,
+	1, 2, 3,            /* manufacturer, product, serial strings */
+	1
+};
+
+const uint8_t usb_cdc_cfgdesc[67] =
+{
+	9, 0x02, 67, 0, 2, 1, 0, 0x80, 50,      /* bus powered, 100mA */
+
+	/* communication interface */
+	9, 0x04, 0, 0, 1, 0x02, 0x02, 0x01, 0,
+	5, 0x24, 0x00, 0x10, 0x01,              /* header */
+	5, 0x24, 0x01, 0x00, 0x01,              /* call management */
+	4, 0x24, 0x02, 0x02,                    /* ACM - line coding & state */
+	5, 0x24, 0x06, 0, 1,                    /* union */
+	7, 0x05, USB_CDC_CMD_EP, 0x03, 8, 0, 16,
+
+	/* data interface */
+	9, 0x04, 1, 0, 2, 0x0A, 0x00, 0x00, 0,
+	7, 0x05, USB_CDC_OUT_EP, 0x02, USB_CDC_MPS, 0, 0,
+	7, 0x05, USB_CDC_IN_EP, 0x02, USB_CDC_MPS, 0, 0,
+};
+
+const uint8_t usb_cdc_langid[4] = {4, 0x03, 0x09, 0x04};
+
+/*
+ * start the next part of a control IN transfer
+ */
+static void usb_cdc_ep0_next(void)
+{
+	uint16_t len = usb_cdc_ep0rem > USB_CDC_MPS ? USB_CDC_MPS : usb_cdc_ep0rem;
+
+	HAL_PCD_EP_Transmit(&hpcd, 0x80, (uint8_t *)usb_cdc_ep0ptr, len);
+	usb_cdc_ep0ptr += len;
+	usb_cdc_ep0rem -= len;
+}
+
+/*
+ * reply to a control IN request - a short reply that ends on a packet
+ * boundary needs a ZLP to finish
+ */
+static void usb_cdc_ep0_send(const uint8_t *buf, uint16_t len, uint16_t wlen)
+{
+	if(len > wlen)
+		len = wlen;
+	usb_cdc_ep0ptr = buf;
+	usb_cdc_ep0rem = len;
+	usb_cdc_ep0zlp = (len < wlen) && !(len % USB_CDC_MPS);
+	usb_cdc_ep0state = USB_CDC_EP0_DATA_IN;
+	usb_cdc_ep0_next();
+}
+
+static void usb_cdc_ep0_status(void)
+{
+	usb_cdc_ep0state = USB_CDC_EP0_STATUS_IN;
+	HAL_PCD_EP_Transmit(&hpcd, 0x80, NULL, 0);
+}
+
+static void usb_cdc_ep0_stall(void)
+{
+	usb_cdc_ep0state = USB_CDC_EP0_IDLE;
+	HAL_PCD_EP_SetStall(&hpcd, 0x80);
+	HAL_PCD_EP_SetStall(&hpcd, 0x00);
+}
+
+/*
+ * ASCII to a string descriptor in the EP0 buffer
+ */
+static uint8_t usb_cdc_strdesc(const char *str)
+{
+	uint8_t len = 2;
+
+	while(*str && (len < USB_CDC_MPS))
+	{
+		usb_cdc_ep0buf[len++] = *str++;
+		usb_cdc_ep0buf[len++] = 0;
+	}
+	usb_cdc_ep0buf[0] = len;
+	usb_cdc_ep0buf[1] = 0x03;
+
+	return len;
+}
+
+static void usb_cdc_getdesc(uint16_t val, uint16_t wlen)
+{
+	char serial[25];
+	uint32_t *uid = (uint32_t *)UID_BASE;
+	uint8_t i;
+
+	switch(val >> 8)
+	{
+		case 0x01:
+			usb_cdc_ep0_send(usb_cdc_devdesc, sizeof(usb_cdc_devdesc), wlen);
+			return;
+
+		case 0x02:
+			usb_cdc_ep0_send(usb_cdc_cfgdesc, sizeof(usb_cdc_cfgdesc), wlen);
+			return;
+
+		case 0x03:
+			switch(val & 0xFF)
+			{
+				case 0:
+					usb_cdc_ep0_send(usb_cdc_langid, 4, wlen);
+					return;
+
+				case 1:
+					usb_cdc_ep0_send(usb_cdc_ep0buf,
+						usb_cdc_strdesc("f405_feather"), wlen);
+					return;
+
+				case 2:
+					usb_cdc_ep0_send(usb_cdc_ep0buf,
+						usb_cdc_strdesc("F405 Feather CDC"), wlen);
+					return;
+
+				case 3:
+					/* 96-bit unique ID in hex */
+					for(i=0;i<24;i++)
+						serial[i] = "0123456789ABCDEF"[(uid[i>>3] >>
+							(28 - 4*(i & 7))) & 15];
+					serial[24] = 0;
+					usb_cdc_ep0_send(usb_cdc_ep0buf, usb_cdc_strdesc(serial),
+						wlen);
+					return;
+			}
+			break;
+	}
+
+	/* device qualifier etc. - we're full speed only */
+	usb_cdc_ep0_stall();
+}
+
+/*
+ * fill the TX ring with the test pattern - called with IRQs masked
+ */
+static void usb_cdc_fill(void)
+{
+	uint32_t idx, n;
+	uint8_t *dst;
+
+	while(usb_cdc_test_rem)
+	{
+		idx = usb_cdc_head & (USB_CDC_TXBUFSZ-1);
+		n = USB_CDC_TXBUFSZ - (usb_cdc_head - usb_cdc_tail);
+		if(n > USB_CDC_TXBUFSZ - idx)
+			n = USB_CDC_TXBUFSZ - idx;
+		if(n > usb_cdc_test_rem)
+			n = usb_cdc_test_rem;
+		if(!n)
+			return;
+
+		dst = &usb_cdc_txbuf[idx];
+		usb_cdc_head += n;
+		usb_cdc_test_rem -= n;
+		while(n--)
+			*dst++ = usb_cdc_test_seq++;
+	}
+}
+
+/*
+ * start an IN transfer on the oldest contiguous data if idle - called
+ * with IRQs masked or from the USB IRQ
+ */
+static void usb_cdc_kick(void)
+{
+	uint32_t len, idx;
+
+	if(usb_cdc_busy || !usb_cdc_st.configured)
+		return;
+
+	usb_cdc_fill();
+
+	len = usb_cdc_head - usb_cdc_tail;
+	if(!len)
+	{
+		/* a transfer that ended on a full packet needs a ZLP */
+		if(usb_cdc_zlp)
+		{
+			usb_cdc_zlp = 0;
+			usb_cdc_txlen = 0;
+			usb_cdc_busy = 1;
+			HAL_PCD_EP_Transmit(&hpcd, USB_CDC_IN_EP, NULL, 0);
+		}
+		return;
+	}
+
+	idx = usb_cdc_tail & (USB_CDC_TXBUFSZ-1);
+	if(len > USB_CDC_TXBUFSZ - idx)
+		len = USB_CDC_TXBUFSZ - idx;
+	if(len > USB_CDC_TXCHUNK)
+		len = USB_CDC_TXCHUNK;
+
+	usb_cdc_txlen = len;
+	usb_cdc_busy = 1;
+	HAL_PCD_EP_Transmit(&hpcd, USB_CDC_IN_EP, &usb_cdc_txbuf[idx], len);
+}
+
+/*
+ * re-arm the OUT endpoint if a whole packet fits
+ */
+static void usb_cdc_rx_arm(void)
+{
+	if(USB_CDC_RXBUFSZ - (usb_cdc_rx_wr - usb_cdc_rx_rd) >= USB_CDC_MPS)
+	{
+		usb_cdc_rx_held = 0;
+		HAL_PCD_EP_Receive(&hpcd, USB_CDC_OUT_EP, usb_cdc_rxpkt, USB_CDC_MPS);
+	}
+	else
+		usb_cdc_rx_held = 1;
+}
+
+/*
+ * bus reset - back to the default state on EP0
+ */
+void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
+{
+	HAL_PCD_EP_Open(hpcd, 0x00, USB_CDC_MPS, EP_TYPE_CTRL);
+	HAL_PCD_EP_Open(hpcd, 0x80, USB_CDC_MPS, EP_TYPE_CTRL);
+
+	usb_cdc_st.configured = 0;
+	usb_cdc_st.dtr = 0;
+	usb_cdc_st.resets++;
+	usb_cdc_ep0state = USB_CDC_EP0_IDLE;
+
+	/* anything queued was for the old session */
+	usb_cdc_busy = 0;
+	usb_cdc_zlp = 0;
+	usb_cdc_test_rem = 0;
+	usb_cdc_st.dropped += usb_cdc_head - usb_cdc_tail;
+	usb_cdc_tail = usb_cdc_head;
+}
+
+void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd)
+{
+	uint8_t *s = (uint8_t *)hpcd->Setup;
+	uint8_t type = s[0], req = s[1];
+	uint16_t val = s[2] | (s[3] << 8);
+	uint16_t idx = s[4] | (s[5] << 8);
+	uint16_t len = s[6] | (s[7] << 8);
+
+	if((type & 0x60) == 0x00)
+	{
+		/* standard requests */
+		switch(req)
+		{
+			case 0x00:  /* GET_STATUS */
+				usb_cdc_ep0buf[0] = 0;
+				usb_cdc_ep0buf[1] = 0;
+				usb_cdc_ep0_send(usb_cdc_ep0buf, 2, len);
+				return;
+
+			case 0x01:  /* CLEAR_FEATURE */
+			case 0x03:  /* SET_FEATURE */
+				if(((type & 0x1F) == 0x02) && (val == 0) && (idx & 0x7F))
+				{
+					/* endpoint halt */
+					if(req == 0x01)
+						HAL_PCD_EP_ClrStall(hpcd, idx);
+					else
+						HAL_PCD_EP_SetStall(hpcd, idx);
+				}
+				usb_cdc_ep0_status();
+				return;
+
+			case 0x05:  /* SET_ADDRESS - the core wants it before status */
+				HAL_PCD_SetAddress(hpcd, val & 0x7F);
+				usb_cdc_ep0_status();
+				return;
+
+			case 0x06:  /* GET_DESCRIPTOR */
+				usb_cdc_getdesc(val, len);
+				return;
+
+			case 0x08:  /* GET_CONFIGURATION */
+				usb_cdc_ep0buf[0] = usb_cdc_st.configured;
+				usb_cdc_ep0_send(usb_cdc_ep0buf, 1, len);
+				return;
+
+			case 0x09:  /* SET_CONFIGURATION */
+				if(val > 1)
+					break;
+				if(val && !usb_cdc_st.configured)
+				{
+					HAL_PCD_EP_Open(hpcd, USB_CDC_IN_EP, USB_CDC_MPS,
+						EP_TYPE_BULK);
+					HAL_PCD_EP_Open(hpcd, USB_CDC_OUT_EP, USB_CDC_MPS,
+						EP_TYPE_BULK);
+					HAL_PCD_EP_Open(hpcd, USB_CDC_CMD_EP, 8, EP_TYPE_INTR);
+					usb_cdc_st.configured = 1;
+					usb_cdc_rx_arm();
+				}
+				else if(!val && usb_cdc_st.configured)
+				{
+					HAL_PCD_EP_Close(hpcd, USB_CDC_IN_EP);
+					HAL_PCD_EP_Close(hpcd, USB_CDC_OUT_EP);
+					HAL_PCD_EP_Close(hpcd, USB_CDC_CMD_EP);
+					usb_cdc_st.configured = 0;
+					usb_cdc_st.dtr = 0;
+					usb_cdc_busy = 0;
+				}
+				usb_cdc_ep0_status();
+				return;
+
+			case 0x0A:  /* GET_INTERFACE */
+				usb_cdc_ep0buf[0] = 0;
+				usb_cdc_ep0_send(usb_cdc_ep0buf, 1, len);
+				return;
+
+			case 0x0B:  /* SET_INTERFACE */
+				usb_cdc_ep0_status();
+				return;
+		}
+	}
+	else if((type & 0x60) == 0x20)
+	{
+		/* CDC class requests */
+		switch(req)
+		{
+			case 0x20:  /* SET_LINE_CODING */
+				if(len > sizeof(usb_cdc_linecoding))
+					break;
+				usb_cdc_ep0state = USB_CDC_EP0_DATA_OUT;
+				HAL_PCD_EP_Receive(hpcd, 0x00, usb_cdc_linecoding, len);
+				return;
+
+			case 0x21:  /* GET_LINE_CODING */
+				usb_cdc_ep0_send(usb_cdc_linecoding,
+					sizeof(usb_cdc_linecoding), len);
+				return;
+
+			case 0x22:  /* SET_CONTROL_LINE_STATE */
+				usb_cdc_st.dtr = val & 1;
+				usb_cdc_ep0_status();
+				return;
+
+			case 0x23:  /* SEND_BREAK */
+				usb_cdc_ep0_status();
+				return;
+		}
+	}
+
+	usb_cdc_ep0_stall();
+}
+
+void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+	if(epnum == 0)
+	{
+		if(usb_cdc_ep0state != USB_CDC_EP0_DATA_IN)
+			usb_cdc_ep0state = USB_CDC_EP0_IDLE;
+		else if(usb_cdc_ep0rem)
+			usb_cdc_ep0_next();
+		else if(usb_cdc_ep0zlp)
+		{
+			usb_cdc_ep0zlp = 0;
+			HAL_PCD_EP_Transmit(hpcd, 0x80, NULL, 0);
+		}
+		else
+		{
+			usb_cdc_ep0state = USB_CDC_EP0_STATUS_OUT;
+			HAL_PCD_EP_Receive(hpcd, 0x00, NULL, 0);
+		}
+	}
+	else if(epnum == (USB_CDC_IN_EP & 0x7F))
+	{
+		usb_cdc_tail += usb_cdc_txlen;
+		usb_cdc_st.sent += usb_cdc_txlen;
+		usb_cdc_zlp = usb_cdc_txlen && !(usb_cdc_txlen % USB_CDC_MPS);
+		usb_cdc_busy = 0;
+		usb_cdc_kick();
+	}
+}
+
+void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+	uint32_t len, idx, n;
+
+	if(epnum == 0)
+	{
+		/* line coding arrived - finish with status */
+		if(usb_cdc_ep0state == USB_CDC_EP0_DATA_OUT)
+			usb_cdc_ep0_status();
+		else
+			usb_cdc_ep0state = USB_CDC_EP0_IDLE;
+	}
+	else if(epnum == USB_CDC_OUT_EP)
+	{
+		/* arming guaranteed room for the whole packet */
+		len = HAL_PCD_EP_GetRxCount(hpcd, USB_CDC_OUT_EP);
+		idx = usb_cdc_rx_wr & (USB_CDC_RXBUFSZ-1);
+		n = len < USB_CDC_RXBUFSZ - idx ? len : USB_CDC_RXBUFSZ - idx;
+		memcpy(&usb_cdc_rxbuf[idx], usb_cdc_rxpkt, n);
+		memcpy(usb_cdc_rxbuf, usb_cdc_rxpkt + n, len - n);
+		usb_cdc_rx_wr += len;
+		usb_cdc_rx_arm();
+		idle_post(IDLE_EV_RX);
+	}
+}
+
+void HAL_PCD_SuspendCallback(PCD_HandleTypeDef *hpcd)
+{
+	usb_cdc_st.dtr = 0;
+}
+
+void HAL_PCD_DisconnectCallback(PCD_HandleTypeDef *hpcd)
+{
+	usb_cdc_st.configured = 0;
+	usb_cdc_st.dtr = 0;
+}
+
+/*
+ * pins, clock & IRQ - called from HAL_PCD_Init
+ */
+void HAL_PCD_MspInit(PCD_HandleTypeDef *hpcd)
+{
+	GPIO_InitTypeDef GPIO_InitStruct;
+
+	/* PA11 = DM, PA12 = DP */
+	__HAL_RCC_GPIOA_CLK_ENABLE();
+	GPIO_InitStruct.Pin = GPIO_PIN_11 | GPIO_PIN_12;
+	GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+	GPIO_InitStruct.Alternate = GPIO_AF10_OTG_FS;
+	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+	__HAL_RCC_USB_OTG_FS_CLK_ENABLE();
+
+	HAL_NVIC_SetPriority(OTG_FS_IRQn, 5, 0);
+	HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+}
+
+/*
+ * bring up the device - 48MHz comes from PLLQ = 336/7
+ */
+void usb_cdc_init(void)
+{
+	hpcd.Instance = USB_OTG_FS;
+	hpcd.Init.dev_endpoints = 4;
+	hpcd.Init.speed = PCD_SPEED_FULL;
+	hpcd.Init.dma_enable = DISABLE;
+	hpcd.Init.phy_itface = PCD_PHY_EMBEDDED;
+	hpcd.Init.Sof_enable = DISABLE;
+	hpcd.Init.low_power_enable = DISABLE;
+	hpcd.Init.lpm_enable = DISABLE;
+	hpcd.Init.vbus_sensing_enable = DISABLE;
+	hpcd.Init.use_dedicated_ep1 = DISABLE;
+	if(HAL_PCD_Init(&hpcd) != HAL_OK)
+		return;
+
+	/*
+	 * 320 words of FIFO: shared RX, EP0 and a deep bulk IN FIFO so the
+	 * core always has the next packets ready
+	 */
+	HAL_PCDEx_SetRxFiFo(&hpcd, 0x80);
+	HAL_PCDEx_SetTxFiFo(&hpcd, 0, 0x20);
+	HAL_PCDEx_SetTxFiFo(&hpcd, 1, 0x80);
+	HAL_PCDEx_SetTxFiFo(&hpcd, 2, 0x10);
+
+	HAL_PCD_Start(&hpcd);
+}
+
+/*
+ * queue len bytes - returns the number accepted. Nothing is taken while
+ * no host has the port open. Thread mode waits up to USB_CDC_TIMEOUT ms
+ * for room, IRQs and masked callers drop what doesn't fit.
+ */
+uint32_t usb_cdc_write(const void *buf, uint32_t len)
+{
+	const uint8_t *src = buf;
+	uint32_t prim, space, idx, n, done = 0;
+	uint32_t goal = cyclegoal_ms(USB_CDC_TIMEOUT);
+
+	while(len)
+	{
+		IRQ_LOCK(prim);
+
+		space = USB_CDC_TXBUFSZ - (usb_cdc_head - usb_cdc_tail);
+		n = len < space ? len : space;
+		if(!usb_cdc_st.dtr || usb_cdc_test_rem)
+			n = 0;
+
+		/* copy what fits - two pieces if it wraps */
+		idx = usb_cdc_head & (USB_CDC_TXBUFSZ-1);
+		if(n > USB_CDC_TXBUFSZ - idx)
+		{
+			memcpy(&usb_cdc_txbuf[idx], src, USB_CDC_TXBUFSZ - idx);
+			memcpy(usb_cdc_txbuf, src + USB_CDC_TXBUFSZ - idx,
+				n - (USB_CDC_TXBUFSZ - idx));
+		}
+		else
+			memcpy(&usb_cdc_txbuf[idx], src, n);
+		usb_cdc_head += n;
+		usb_cdc_st.queued += n;
+		usb_cdc_kick();
+		src += n;
+		len -= n;
+		done += n;
+
+		if(len && (!usb_cdc_st.dtr || usb_cdc_test_rem || prim ||
+			__get_IPSR() || !cyclecheck(goal)))
+		{
+			usb_cdc_st.dropped += len;
+			len = 0;
+		}
+		IRQ_UNLOCK(prim);
+	}
+
+	return done;
+}
+
+/*
+ * zero-copy producer - get the contiguous free space at the head of the
+ * ring, fill it, then commit. Main loop only, and not mixed with test.
+ */
+uint32_t usb_cdc_reserve(uint8_t **ptr)
+{
+	uint32_t idx = usb_cdc_head & (USB_CDC_TXBUFSZ-1);
+	uint32_t space = USB_CDC_TXBUFSZ - (usb_cdc_head - usb_cdc_tail);
+
+	*ptr = &usb_cdc_txbuf[idx];
+	if(usb_cdc_test_rem || !usb_cdc_st.dtr)
+		return 0;
+
+	return space < USB_CDC_TXBUFSZ - idx ? space : USB_CDC_TXBUFSZ - idx;
+}
+
+void usb_cdc_commit(uint32_t len)
+{
+	uint32_t prim;
+
+	IRQ_LOCK(prim);
+	usb_cdc_head += len;
+	usb_cdc_st.queued += len;
+	usb_cdc_kick();
+	IRQ_UNLOCK(prim);
+}
+
+/*
+ * output for tiny printf
+ */
+void usb_cdc_putc(void* p, char c)
+{
+	usb_cdc_write(&c, 1);
+}
+
+/*
+ * copy out up to max received bytes - returns the number read
+ */
+uint32_t usb_cdc_read(void *buf, uint32_t max)
+{
+	uint8_t *dst = buf;
+	uint32_t len = usb_cdc_rx_wr - usb_cdc_rx_rd, idx, n, prim;
+
+	if(len > max)
+		len = max;
+	idx = usb_cdc_rx_rd & (USB_CDC_RXBUFSZ-1);
+	n = len < USB_CDC_RXBUFSZ - idx ? len : USB_CDC_RXBUFSZ - idx;
+	memcpy(dst, &usb_cdc_rxbuf[idx], n);
+	memcpy(dst + n, usb_cdc_rxbuf, len - n);
+	usb_cdc_rx_rd += len;
+	usb_cdc_st.received += len;
+
+	/* room again for a held-off packet */
+	if(usb_cdc_rx_held)
+	{
+		IRQ_LOCK(prim);
+		if(usb_cdc_rx_held && usb_cdc_st.configured)
+			usb_cdc_rx_arm();
+		IRQ_UNLOCK(prim);
+	}
+
+	return len;
+}
+
+/*
+ * nonzero while a host has the port open
+ */
+uint8_t usb_cdc_ready(void)
+{
+	return usb_cdc_st.configured && usb_cdc_st.dtr;
+}
+
+/*
+ * stream bytes of a counting pattern for tools/cdcbench - the ring is
+ * refilled from the USB IRQ so it runs at bus speed, not loop speed
+ */
+void usb_cdc_test(uint32_t bytes)
+{
+	uint32_t prim;
+
+	IRQ_LOCK(prim);
+	usb_cdc_test_seq = 0;
+	usb_cdc_test_rem = usb_cdc_st.dtr ? bytes : 0;
+	usb_cdc_kick();
+	IRQ_UNLOCK(prim);
+}
+
+void usb_cdc_get_stats(usb_cdc_stats *st)
+{
+	uint32_t prim;
+
+	IRQ_LOCK(prim);
+	*st = usb_cdc_st;
+	IRQ_UNLOCK(prim);
+}
+
+/*
+ * USB IRQ
+ */
+IRQSTAT_HANDLER(OTG_FS_IRQHandler)
+{
+	HAL_PCD_IRQHandler(&hpcd);
+}
@@ -0,0 +1,38 @@
+/*
+ * usb_cdc.h - USB full-speed CDC-ACM virtual COM port
+ */
+
+#ifndef __usb_cdc__
+#define __usb_cdc__
+
+#include "stm32f4xx_hal.h"
+
+/* ring sizes - must be powers of 2 */
+#define USB_CDC_TXBUFSZ 8192
+#define USB_CDC_RXBUFSZ 512
+
+/* bulk packet size at full speed */
+#define USB_CDC_MPS 64
+
+typedef struct
+{
+	uint32_t queued;        /* accepted into the TX ring */
+	uint32_t sent;          /* completed on the IN endpoint */
+	uint32_t dropped;       /* rejected - full ring or no host */
+	uint32_t received;      /* read from the RX ring */
+	uint32_t resets;        /* bus resets seen */
+	uint8_t configured;     /* host has set the configuration */
+	uint8_t dtr;            /* host has the port open */
+} usb_cdc_stats;
+
+void usb_cdc_init(void);
+uint32_t usb_cdc_write(const void *buf, uint32_t len);
+uint32_t usb_cdc_reserve(uint8_t **ptr);
+void usb_cdc_commit(uint32_t len);
+void usb_cdc_putc(void* p, char c);
+uint32_t usb_cdc_read(void *buf, uint32_t max);
+uint8_t usb_cdc_ready(void);
+void usb_cdc_test(uint32_t bytes);
+void usb_cdc_get_stats(usb_cdc_stats *st);
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ * blogdec.c - host decoder for the blog binary log stream
+ *
+ * Build: gcc -O2 -o blogdec blogdec.c
+ * Usage: blogdec [-c clock_hz] main.elf [capture]
+ *
+ * Reads the .blog format strings from the firmware ELF, then decodes
+ * COBS frames from the capture file (or stdin, e.g. a serial port) and
+ * prints each record with its time in seconds since the first one. Each
+ * record carries the cycles since the one before as a varint and the args
+ * as zigzag varints. Text between frames is passed through so shell
+ * output stays readable.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAXFRAME 256
+#define MAXARGS 6
+
+static char *fmts;
+static uint32_t fmts_sz;
+static double clock_hz = 168e6;
+static uint32_t nrec, nbad;
+
+static uint16_t rd16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * pull the .blog section out of a 32-bit little-endian ELF
+ */
+static int load_elf(const char *name)
+{
+	FILE *f = fopen(name, "rb");
+	uint8_t *elf, *sh, *shstr;
+	long sz;
+	uint32_t shoff, i;
+	uint16_t shentsize, shnum, shstrndx;
+
+	if(!f)
+	{
+		perror(name);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	sz = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	elf = malloc(sz);
+	if(!elf || fread(elf, 1, sz, f) != (size_t)sz)
+	{
+		fprintf(stderr, "%s: read failed\n", name);
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	if(sz < 52 || memcmp(elf, "\177ELF", 4) || elf[4] != 1 || elf[5] != 1)
+	{
+		fprintf(stderr, "%s: not a 32-bit little-endian ELF\n", name);
+		return -1;
+	}
+	shoff = rd32(elf + 32);
+	shentsize = rd16(elf + 46);
+	shnum = rd16(elf + 48);
+	shstrndx = rd16(elf + 50);
+	if(shoff + (uint32_t)shnum * shentsize > (uint32_t)sz || shstrndx >= shnum)
+	{
+		fprintf(stderr, "%s: bad section headers\n", name);
+		return -1;
+	}
+	shstr = elf + rd32(elf + shoff + shstrndx * shentsize + 16);
+
+	for(i=0;i<shnum;i++)
+	{
+		sh = elf + shoff + i * shentsize;
+		if(!strcmp((char *)shstr + rd32(sh), ".blog"))
+		{
+			fmts_sz = rd32(sh + 20);
+			fmts = (char *)elf + rd32(sh + 16);
+			return 0;
+		}
+	}
+
+	fprintf(stderr, "%s: no .blog section\n", name);
+	return -1;
+}
+
+static uint16_t crc16(const uint8_t *buf, int len)
+{
+	uint16_t crc = 0xFFFF;
+	int i;
+
+	while(len--)
+	{
+		crc ^= *buf++ << 8;
+		for(i=0;i<8;i++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+
+	return crc;
+}
+
+/*
+ * undo COBS in place - returns the decoded length or -1
+ */
+static int cobs_decode(uint8_t *buf, int len)
+{
+	int in = 0, out = 0, code, i;
+
+	while(in < len)
+	{
+		code = buf[in++];
+		if(!code || in + code - 1 > len)
+			return -1;
+		for(i=1;i<code;i++)
+			buf[out++] = buf[in++];
+		if(code < 0xFF && in < len)
+			buf[out++] = 0;
+	}
+
+	return out;
+}
+
+/*
+ * LEB128 varint of up to 64 bits - returns the bytes used or -1
+ */
+static int rdvar(const uint8_t *p, int len, uint64_t *v)
+{
+	int n = 0;
+
+	*v = 0;
+	while(n < len && n < 10)
+	{
+		*v |= (uint64_t)(p[n] & 0x7F) << (7 * n);
+		if(!(p[n++] & 0x80))
+			return n;
+	}
+
+	return -1;
+}
+
+/*
+ * split a decoded record - returns the arg count or -1 if it isn't one
+ */
+static int parse(const uint8_t *buf, int len, uint32_t *id, uint64_t *dt,
+	uint32_t *args)
+{
+	int pos, n, nargs = 0;
+	uint64_t v;
+
+	if(len < 5 || crc16(buf, len - 2) != rd16(buf + len - 2))
+		return -1;
+	len -= 2;
+
+	*id = rd16(buf);
+	if((n = rdvar(buf + 2, len - 2, dt)) < 0)
+		return -1;
+
+	/* zigzag args fill the rest */
+	for(pos=2+n;pos<len;pos+=n)
+	{
+		if(nargs == MAXARGS || (n = rdvar(buf + pos, len - pos, &v)) < 0 ||
+			v >> 32)
+			return -1;
+		args[nargs++] = (uint32_t)(v >> 1) ^ -(uint32_t)(v & 1);
+	}
+
+	return nargs;
+}
+
+/*
+ * expand one format string with 32-bit args
+ */
+static void print_fmt(const char *fmt, const uint32_t *args, int nargs)
+{
+	char spec[16];
+	int a = 0, n;
+
+	while(*fmt)
+	{
+		if(*fmt != '%')
+		{
+			putchar(*fmt++);
+			continue;
+		}
+		if(fmt[1] == '%')
+		{
+			putchar('%');
+			fmt += 2;
+			continue;
+		}
+
+		/* copy flags, width & precision, drop length modifiers */
+		n = 0;
+		spec[n++] = *fmt++;
+		while(*fmt && strchr("-+ #0123456789.", *fmt) && n < 12)
+			spec[n++] = *fmt++;
+		while(*fmt == 'l' || *fmt == 'h')
+			fmt++;
+		if(!*fmt)
+			break;
+		spec[n++] = *fmt;
+		spec[n] = 0;
+
+		if(a >= nargs)
+			fputs("<?>", stdout);
+		else if(*fmt == 'd' || *fmt == 'i')
+			printf(spec, (int32_t)args[a++]);
+		else if(strchr("uxXoc", *fmt))
+			printf(spec, args[a++]);
+		else
+		{
+			printf("<%%%c?>", *fmt);
+			a++;
+		}
+		fmt++;
+	}
+	putchar('\n');
+}
+
+/*
+ * handle the bytes between two delimiters
+ */
+static void frame(uint8_t *buf, int len)
+{
+	static uint64_t t0, t;
+	static int started;
+	uint32_t args[MAXARGS], id;
+	uint64_t dt;
+	int dlen, nargs, i;
+	uint8_t copy[MAXFRAME];
+
+	if(!len)
+		return;
+
+	memcpy(copy, buf, len);
+	dlen = cobs_decode(buf, len);
+	nargs = (dlen < 0) ? -1 : parse(buf, dlen, &id, &dt, args);
+	if(nargs < 0)
+	{
+		/* not a record - show it as text unless it's binary junk */
+		for(i=0;i<len;i++)
+			if(copy[i] < ' ' && !strchr("\r\n\t\b", copy[i]))
+				break;
+		if(i == len)
+			fwrite(copy, 1, len, stdout);
+		else
+			nbad++;
+		return;
+	}
+
+	/* the first delta is from boot, so it sets the origin */
+	t += dt;
+	if(!started)
+	{
+		t0 = t;
+		started = 1;
+	}
+
+	printf("[%12.6f] ", (double)(t - t0) / clock_hz);
+	if(id >= fmts_sz || !memchr(fmts + id, 0, fmts_sz - id))
+		printf("<bad id 0x%04X>\n", id);
+	else
+		print_fmt(fmts + id, args, nargs);
+	fflush(stdout);
+	nrec++;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t buf[MAXFRAME];
+	FILE *in = stdin;
+	int c, len = 0, arg = 1;
+
+	if(arg + 1 < argc && !strcmp(argv[arg], "-c"))
+	{
+		clock_hz = atof(argv[arg + 1]);
+		arg += 2;
+	}
+	if(arg >= argc || clock_hz <= 0)
+	{
+		fprintf(stderr, "usage: %s [-c clock_hz] main.elf [capture]\n",
+			argv[0]);
+		return 1;
+	}
+	if(load_elf(argv[arg++]))
+		return 1;
+	if(arg < argc && !(in = fopen(argv[arg], "rb")))
+	{
+		perror(argv[arg]);
+		return 1;
+	}
+
+	while((c = getc(in)) != EOF)
+	{
+		if(!c)
+		{
+			frame(buf, len);
+			len = 0;
+		}
+		else if(len < MAXFRAME)
+			buf[len++] = c;
+		else
+		{
+			/* runaway text - pass it on and start over */
+			frame(buf, len);
+			len = 0;
+			buf[len++] = c;
+		}
+	}
+	frame(buf, len);
+
+	fprintf(stderr, "%u records, %u bad frames\n", nrec, nbad);
+	return 0;
+}
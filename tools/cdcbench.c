@@ -0,0 +1,135 @@
+/*
+ * cdcbench.c - host side USB CDC throughput test
+ *
+ * Build: gcc -O2 -o cdcbench cdcbench.c
+ * Usage: cdcbench /dev/ttyACM0 [bytes]
+ *
+ * Needs USB_CONSOLE in blinky/main.c. Sends "usb test <bytes>" to the
+ * shell, waits for the start line, then times the counting pattern from
+ * usb_cdc_test() and checks every byte of it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/time.h>
+#include <sys/select.h>
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/*
+ * read with a timeout - returns bytes read, 0 on timeout
+ */
+static int rd(int fd, unsigned char *buf, int max, int ms)
+{
+	fd_set fds;
+	struct timeval tv;
+	int n;
+
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	tv.tv_sec = ms / 1000;
+	tv.tv_usec = (ms % 1000) * 1000;
+	if(select(fd + 1, &fds, NULL, NULL, &tv) <= 0)
+		return 0;
+	n = read(fd, buf, max);
+	return n < 0 ? 0 : n;
+}
+
+int main(int argc, char **argv)
+{
+	static const char sync[] = "usb test start\n\r";
+	unsigned char buf[16384], seq = 0;
+	unsigned long bytes = 4UL << 20, got = 0, errs = 0;
+	struct termios tio;
+	char cmd[64];
+	double t0, t;
+	int fd, n, i, s = 0;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s /dev/ttyACM0 [bytes]\n", argv[0]);
+		return 1;
+	}
+	if(argc > 2)
+		bytes = strtoul(argv[2], NULL, 0);
+
+	fd = open(argv[1], O_RDWR | O_NOCTTY);
+	if(fd < 0)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	tcgetattr(fd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(fd, TCSANOW, &tio);
+	tcflush(fd, TCIOFLUSH);
+
+	/* drop any old output, then start the test */
+	while(rd(fd, buf, sizeof(buf), 100))
+		;
+	n = snprintf(cmd, sizeof(cmd), "\rusb test %lu\r", bytes);
+	if(write(fd, cmd, n) != n)
+	{
+		perror("write");
+		return 1;
+	}
+
+	/* find the start line - the pattern begins right after it */
+	t0 = 0;
+	while(!t0)
+	{
+		n = rd(fd, buf, sizeof(buf), 2000);
+		if(!n)
+		{
+			fprintf(stderr, "no start line - is USB_CONSOLE on?\n");
+			return 1;
+		}
+		for(i=0;i<n;i++)
+		{
+			s = (buf[i] == (unsigned char)sync[s]) ? s + 1 :
+				(buf[i] == (unsigned char)sync[0]);
+			if(!sync[s])
+			{
+				t0 = now();
+				i++;
+				break;
+			}
+		}
+	}
+
+	/* check the pattern - leftovers of this read first */
+	for(;;)
+	{
+		for(;i<n && got<bytes;i++,got++)
+			if(buf[i] != seq++)
+			{
+				errs++;
+				seq = buf[i] + 1;
+			}
+		if(got >= bytes)
+			break;
+		n = rd(fd, buf, sizeof(buf), 1000);
+		i = 0;
+		if(!n)
+		{
+			fprintf(stderr, "timeout after %lu bytes\n", got);
+			break;
+		}
+	}
+	t = now() - t0;
+
+	printf("%lu bytes in %.3f s = %.1f kB/s, %lu pattern errors\n",
+		got, t, got / t / 1000.0, errs);
+	close(fd);
+	return errs || got < bytes;
+}
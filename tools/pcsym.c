@@ -0,0 +1,243 @@
+/*
+ * pcsym.c - resolve pcsamp captures into flat & call-site profiles
+ *
+ * Build: gcc -O2 -o pcsym pcsym.c
+ * Usage: pcsym main.elf [capture] [top]
+ *
+ * The capture is console text holding the "PCS" lines from the shell's
+ * "pcs dump" - anything else in it is skipped. Samples are matched to
+ * function symbols in main.elf. The call-site profile pairs each sample's
+ * function with the one its LR points into, which is exact in leaf code
+ * and a good hint elsewhere.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct
+{
+	uint32_t addr;
+	uint32_t size;
+	const char *name;
+} sym;
+
+typedef struct
+{
+	int fn;
+	int caller;
+	uint32_t count;
+} hit;
+
+static sym *syms;
+static int nsyms;
+static hit *hits;
+static int nhits, maxhits;
+
+static uint16_t rd16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int symcmp(const void *a, const void *b)
+{
+	const sym *x = a, *y = b;
+
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+/*
+ * load the function symbols from a 32-bit little-endian ELF
+ */
+static int load_elf(const char *name)
+{
+	FILE *f = fopen(name, "rb");
+	uint8_t *elf, *sh, *ent;
+	const char *str;
+	long sz;
+	uint32_t shoff, i, j, off, size, entsz;
+	uint16_t shentsize, shnum;
+
+	if(!f)
+	{
+		perror(name);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	sz = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	elf = malloc(sz);
+	if(!elf || fread(elf, 1, sz, f) != (size_t)sz)
+	{
+		fprintf(stderr, "%s: read failed\n", name);
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	if(sz < 52 || memcmp(elf, "\177ELF", 4) || elf[4] != 1 || elf[5] != 1)
+	{
+		fprintf(stderr, "%s: not a 32-bit little-endian ELF\n", name);
+		return -1;
+	}
+	shoff = rd32(elf + 32);
+	shentsize = rd16(elf + 46);
+	shnum = rd16(elf + 48);
+
+	for(i=0;i<shnum;i++)
+	{
+		sh = elf + shoff + i * shentsize;
+		if(rd32(sh + 4) != 2)   /* SHT_SYMTAB */
+			continue;
+		off = rd32(sh + 16);
+		size = rd32(sh + 20);
+		entsz = rd32(sh + 36);
+		str = (const char *)elf + rd32(elf + shoff +
+			rd32(sh + 24) * shentsize + 16);
+
+		syms = calloc(size / entsz, sizeof(sym));
+		for(j=0;j<size/entsz;j++)
+		{
+			ent = elf + off + j * entsz;
+			if((ent[12] & 15) != 2) /* STT_FUNC */
+				continue;
+			syms[nsyms].addr = rd32(ent + 4) & ~1;
+			syms[nsyms].size = rd32(ent + 8);
+			syms[nsyms].name = str + rd32(ent);
+			nsyms++;
+		}
+		qsort(syms, nsyms, sizeof(sym), symcmp);
+		return 0;
+	}
+
+	fprintf(stderr, "%s: no symbol table - was it stripped?\n", name);
+	return -1;
+}
+
+/*
+ * function containing addr, or -1
+ */
+static int lookup(uint32_t addr)
+{
+	int lo = 0, hi = nsyms - 1, mid;
+
+	addr &= ~1;
+	while(lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		if(addr < syms[mid].addr)
+			hi = mid - 1;
+		else if(mid + 1 < nsyms && addr >= syms[mid + 1].addr)
+			lo = mid + 1;
+		else
+			return (!syms[mid].size ||
+				addr < syms[mid].addr + syms[mid].size) ? mid : -1;
+	}
+
+	return -1;
+}
+
+static const char *fname(int fn)
+{
+	return fn < 0 ? "(unknown)" : syms[fn].name;
+}
+
+static void add(int fn, int caller)
+{
+	int i;
+
+	for(i=0;i<nhits;i++)
+		if(hits[i].fn == fn && hits[i].caller == caller)
+		{
+			hits[i].count++;
+			return;
+		}
+	if(nhits == maxhits)
+	{
+		maxhits = maxhits ? 2 * maxhits : 256;
+		hits = realloc(hits, maxhits * sizeof(hit));
+	}
+	hits[nhits].fn = fn;
+	hits[nhits].caller = caller;
+	hits[nhits].count = 1;
+	nhits++;
+}
+
+static int hitcmp(const void *a, const void *b)
+{
+	const hit *x = a, *y = b;
+
+	return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	FILE *in = stdin;
+	char line[256];
+	unsigned int pc, lr;
+	uint32_t total = 0;
+	hit *flat;
+	int nflat = 0, top = 30, i, j, caller;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s main.elf [capture] [top]\n", argv[0]);
+		return 1;
+	}
+	if(load_elf(argv[1]))
+		return 1;
+	if(argc > 2 && strcmp(argv[2], "-") && !(in = fopen(argv[2], "r")))
+	{
+		perror(argv[2]);
+		return 1;
+	}
+	if(argc > 3)
+		top = atoi(argv[3]);
+
+	while(fgets(line, sizeof(line), in))
+	{
+		if(sscanf(line, "PCS %x %x", &pc, &lr) != 2)
+			continue;
+		/* an EXC_RETURN LR means an IRQ had just been entered */
+		caller = (lr >= 0xFFFFFFE0) ? -2 : lookup(lr);
+		add(lookup(pc), caller);
+		total++;
+	}
+	if(!total)
+	{
+		fprintf(stderr, "no PCS samples found\n");
+		return 1;
+	}
+
+	/* flat profile - merge the callers */
+	flat = calloc(nhits, sizeof(hit));
+	for(i=0;i<nhits;i++)
+	{
+		for(j=0;j<nflat && flat[j].fn != hits[i].fn;j++)
+			;
+		if(j == nflat)
+			flat[nflat++].fn = hits[i].fn;
+		flat[j].count += hits[i].count;
+	}
+	qsort(flat, nflat, sizeof(hit), hitcmp);
+	qsort(hits, nhits, sizeof(hit), hitcmp);
+
+	printf("%u samples\n\nflat profile\n", total);
+	for(i=0;i<nflat && i<top;i++)
+		printf("%6.2f%% %7u  %s\n", 100.0 * flat[i].count / total,
+			flat[i].count, fname(flat[i].fn));
+
+	printf("\ncall sites\n");
+	for(i=0;i<nhits && i<top;i++)
+		printf("%6.2f%% %7u  %s <- %s\n", 100.0 * hits[i].count / total,
+			hits[i].count, fname(hits[i].fn),
+			hits[i].caller == -2 ? "(irq entry)" : fname(hits[i].caller));
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * rfftref.c - host check of common/rfft.c against a direct DFT
+ *
+ * Build: gcc -O2 -I../CMSIS -o rfftref rfftref.c -lm
+ * Usage: rfftref [trials]
+ *
+ * Compiles the firmware rfft.c as-is with the CMSIS, cycle counter and
+ * printf headers stubbed out, then runs random inputs through every
+ * supported size and compares each packed output bin with a double
+ * precision DFT. Errors are relative to the largest bin magnitude.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+/* stand-ins for what rfft.c pulls from the firmware headers */
+#define _ARM_MATH_H
+#define __cyclesleep__
+#define __TFP_PRINTF__
+typedef float float32_t;
+#define PI 3.14159265358979f
+#define __CLZ(x) __builtin_clz(x)
+static void start_meas(void) {}
+static void end_meas(void) {}
+static void get_meas(uint32_t *act, uint32_t *tot) { *act = *tot = 0; }
+
+#include "../common/rfft.c"
+
+/* limit on the relative error for a pass */
+#define RFFTREF_TOL 1e-4
+
+/*
+ * worst relative error of one random n point transform
+ */
+static double check(uint16_t n)
+{
+	static float32_t buf[RFFT_MAXN];
+	static double x[RFFT_MAXN], re[RFFT_MAXN/2+1], im[RFFT_MAXN/2+1];
+	double a, peak = 0.0, err = 0.0, e;
+	uint16_t i, k;
+
+	for(i=0;i<n;i++)
+	{
+		x[i] = 2.0*rand()/RAND_MAX - 1.0;
+		buf[i] = (float32_t)x[i];
+	}
+
+	/* direct DFT - exact phase from the index product mod n */
+	for(k=0;k<=n/2;k++)
+	{
+		re[k] = im[k] = 0.0;
+		for(i=0;i<n;i++)
+		{
+			a = 2.0*M_PI*(double)(((uint32_t)i*k) % n)/n;
+			re[k] += x[i]*cos(a);
+			im[k] -= x[i]*sin(a);
+		}
+		e = sqrt(re[k]*re[k] + im[k]*im[k]);
+		if(e > peak)
+			peak = e;
+	}
+
+	rfft(buf, n);
+
+	/* packed as buf[0] = DC, buf[1] = Nyquist, then re/im from bin 1 */
+	err = fabs(buf[0] - re[0]);
+	e = fabs(buf[1] - re[n/2]);
+	if(e > err)
+		err = e;
+	for(k=1;k<n/2;k++)
+	{
+		e = hypot(buf[2*k] - re[k], buf[2*k+1] - im[k]);
+		if(e > err)
+			err = e;
+	}
+
+	return err / peak;
+}
+
+int main(int argc, char **argv)
+{
+	int trials = (argc > 1) ? atoi(argv[1]) : 4, t, fail = 0;
+	uint16_t n;
+	double err, worst;
+
+	rfft_init();
+
+	/* unsupported sizes must be refused */
+	if(!rfft((float32_t *)rfft_tw, 48) || !rfft((float32_t *)rfft_tw, 2*RFFT_MAXN))
+	{
+		printf("bad size accepted\n");
+		fail = 1;
+	}
+
+	srand(1);
+	for(n=1<<RFFT_MINLOG2;n && n<=RFFT_MAXN;n<<=1)
+	{
+		worst = 0.0;
+		for(t=0;t<trials;t++)
+		{
+			err = check(n);
+			if(err > worst)
+				worst = err;
+		}
+		printf("rfft %4d: max rel err %.2e %s\n", n, worst,
+			worst < RFFTREF_TOL ? "ok" : "FAIL");
+		if(worst >= RFFTREF_TOL)
+			fail = 1;
+	}
+
+	return fail;
+}